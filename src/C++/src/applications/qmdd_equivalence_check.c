@@ -167,7 +167,7 @@ int main(int argc, char *argv[] )
   
   
   printf("OUTPUT1: -DATE %s -TIME %s -SOURCE %s -HOST %s\n",date,curr_time,__FILE__,hostName);
-  printf("OUTPUT2: -MAXN %d -UTBCKTS %d -CTSIZE %d -TTSIZE %d -GCLIMIT %d -CNTSIZE %d\n",MAXN,NBUCKET,CTSLOTS,TTSLOTS,GCLIMIT1,COMPLEXTSIZE);
+  printf("OUTPUT2: -MAXN %d -UTBCKTS %d -CTSIZE %d -TTSIZE %d -GCLIMIT %d -CNTSIZE %d\n",MAXN,NBUCKET,CTslots,TTSLOTS,GCinitialLimit,COMPLEXTSIZE);
   printf("OUTPUT3: ");
   printf("-PEAK %ld -CPU ",QMDDpeaknodecount);
   printCPUtime(otime);
@@ -18,14 +18,48 @@ format.
     Routines            
 *****************************************************************/
 
-int getlabel(char lab[],QMDDrevlibDescription circ,int *cont)
+static unsigned QMDDlabelSlot(const char *lab)
+// hash a variable name to its first slot in the label hash table
+{
+  unsigned h=0;
+
+  while(*lab) h=h*31+(unsigned char)*lab++;
+  return(h&(LABELHASH-1));
+}
+
+void QMDDhashLabels(QMDDrevlibDescription *circ)
+// enter the variable names of the circuit lines into the label hash table
+// (linear probing; the table is more than half empty as LABELHASH>2*MAXN)
+{
+  int i;
+  unsigned h;
+
+  for(h=0;h<LABELHASH;h++) circ->labelHash[h]=-1;
+  for(i=0;i<circ->n;i++)
+  {
+    h=QMDDlabelSlot(circ->line[i].variable);
+    while(circ->labelHash[h]!=-1) h=(h+1)&(LABELHASH-1);
+    circ->labelHash[h]=i;
+  }
+}
+
+int QMDDfindLabel(const char *lab,QMDDrevlibDescription *circ)
+// return the line index of variable name lab or -1 if there is no such line
+{
+  unsigned h;
+  int i;
+
+  for(h=QMDDlabelSlot(lab);(i=circ->labelHash[h])!=-1;h=(h+1)&(LABELHASH-1))
+    if(0==strcmp(lab,circ->line[i].variable)) return(i);
+  return(-1);
+}
+
+int getlabel(char lab[],QMDDrevlibDescription *circ,int *cont)
 // get a label and return its index in a global Label table
 // cont is returned as 1 (positive control/target), 0 (negative control), or -1 if character after label is '\n'
-
-// this is a really quick and dirty implementation that uses
-// linear searching
+// labels are looked up in the hash table built by QMDDrevlibHeader
 {
-  int i,k;
+  int i;
   char ch = lab[strlen(lab)-1]; // last character of lab
   
   
@@ -33,8 +67,6 @@ int getlabel(char lab[],QMDDrevlibDescription circ,int *cont)
   if (lab[0] == '-'){   // if negative control
   *cont = 0;
     lab = &lab[1];
-  //for (int i=0; i<strlen(lab); i++)
-  //    lab[i] = lab[i+1];
   }
   
   if (ch == '\n')
@@ -42,15 +74,9 @@ int getlabel(char lab[],QMDDrevlibDescription circ,int *cont)
     
     if(lab[0]==' ') return(-1);			// no label
     
-    for(i=0;i<circ.n;i++) 			// lookup up label in table
-    {
-      if(0==strcmp(lab,circ.line[i].variable)) 
-      {
-	return(i); // return if found
-      }
-    }
-    printf("label not found: %s\n",lab);
-    return -1;
+    i=QMDDfindLabel(lab,circ);
+    if(i<0) printf("label not found: %s\n",lab);
+    return(i);
 }
 
 
@@ -128,17 +154,20 @@ QMDDedge QMDDreadGateFromString(char *str, QMDDrevlibDescription *circ)
 		for(i=0;i<n;i++) line[i]=-1;
 		for(i=0;i<m-1;i++)
 		{;
-			k=k+getstr(&str[k],token);
-			j=getlabel(token,*circ,&cont);
+			if((j=getstr(&str[k],token,MAXSTRLEN))<0) throwException("gate label too long\n",0);
+			k=k+j;
+			j=getlabel(token,circ,&cont);
 			if (j==-1) {f.p=NULL; return(f);}
 			if (cont == -1) {f.p=NULL; printf("Too few variables."); return(f);}
 			line[j]=cont; // control line  NOTE embedded assignment to j
 			pc[i]=j;
 		}
-		k=k+getstr(&str[k],token);
-		t=getlabel(token,*circ,&cont);
+		if((t=getstr(&str[k],token,MAXSTRLEN))<0) throwException("gate label too long\n",0);
+		k=k+t;
+		t=getlabel(token,circ,&cont);
 		if (t==-1) {f.p=NULL; return(f);}
 		line[t]=2;  // target line  NOTE embedded assignment to t
+		for(i=0;i<n;i++) circ->gateline[i]=(line[i]!=-1);
 
 		// set f to point to QMDD for gate
 		if(ch1=='T'||ch1=='C'||ch1=='N') // T, C or N gate
@@ -146,12 +175,7 @@ QMDDedge QMDDreadGateFromString(char *str, QMDDrevlibDescription *circ)
 			if(m==1||ch1=='N') circ->ngate=1;
 			else if(m==2||ch1=='C') circ->cgate=1;
 			else circ->tgate=1;
-			f=TTlookup(n,m,t,line);
-			if(f.p==NULL)
-			{
-				f=QMDDmvlgate(Nm,n,line);
-				TTinsert(n,m,t,line,f);
-			}
+			f=QMDDmvlgate(Nm,n,line);
 			(*circ).qcost+=gate_qcost(m,n,TOFFOLI_GATE);
 		}
 		else if(ch1=='F') // Fredkin gate
@@ -229,20 +253,35 @@ return(f);
 
 
 QMDDedge QMDDreadGate(FILE *infile,QMDDrevlibDescription *circ)
+// reads one gate from infile (QMDDcircuitRevlib reads all gates at once with readTextLines)
 {
 
-  char lineFromInfile[256]; // read one line from the FILE
+  static char *lineFromInfile; // read one line from the FILE (grows as needed)
+  static int size;
+  int i;
   char ch1;
 
   ch1=getch(infile);
   // skip characters until the first meaningful is read
-  while(ch1==' '||ch1=='\n'||ch1=='#') {
+  while((ch1==' '||ch1=='\n'||ch1=='#')&&!feof(infile)) {
 	  if (ch1=='#')
 		  skip2eol(infile);
 	  ch1=getch(infile);
   }
-  lineFromInfile[0] = ch1;
-  getline(infile,&lineFromInfile[1]);
+  i=0;
+  while(1) // copy the rest of the line
+  {
+	  if(i+1>=size)
+	  {
+		  size=size?2*size:256;
+		  lineFromInfile=(char *)realloc(lineFromInfile,size);
+		  if(lineFromInfile==NULL) throwException("QMDDreadGate: out of memory",1);
+	  }
+	  lineFromInfile[i++]=ch1;
+	  if(ch1=='\n'||feof(infile)) break;
+	  ch1=getch(infile);
+  }
+  lineFromInfile[i]=0;
 
   //printf("readGateFromString: %s\n",lineFromInfile);
   
@@ -346,24 +385,104 @@ QMDDrevlibDescription QMDDrevlibHeader(FILE *infile)
 
   if(VERBOSE) printf("completed.\n");
   for(i=0;i<circ.n;i++) circ.inperm[i]=i;
+  QMDDhashLabels(&circ);
 
   return(circ);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 
+static QMDDedge QMDDmultiplyParts(QMDDedge later,QMDDedge earlier)
+// product of two referenced partial circuit QMDDs (later gates on the left);
+// the result is referenced, the two parts are released
+{
+	QMDDedge e;
+
+	e=QMDDmultiply(later,earlier);
+	QMDDincref(e);
+	QMDDdecref(later);
+	QMDDdecref(earlier);
+	return(e);
+}
+
+typedef struct CircuitBuild // gate QMDDs multiplied so far (see QMDDcircuitRevlib)
+{
+	QMDDedge e,win,part[64];	// circuit, current window, parts of the balanced tree
+	int first,wsize,parts,size[64];	// no gate yet / gates in window / no. of parts / gates per part
+} CircuitBuild;
+
+static void QMDDbuildGate(CircuitBuild *b,QMDDedge f)
+// multiply the referenced QMDD f of the next gate(s) in
+{
+	if(QMDDbuildWindow<=0) // balanced tree: parts of equal size (a power of 2) are combined
+	{
+		b->part[b->parts]=f;
+		b->size[b->parts++]=1;
+		while(b->parts>1&&b->size[b->parts-1]==b->size[b->parts-2])
+		{
+			b->part[b->parts-2]=QMDDmultiplyParts(b->part[b->parts-1],b->part[b->parts-2]);
+			b->size[b->parts-2]*=2;
+			b->parts--;
+		}
+	}
+	else
+	{
+		b->win=b->wsize?QMDDmultiplyParts(f,b->win):f; // multiply QMDD for gate * QMDD for window to date
+		if(++b->wsize==QMDDbuildWindow)
+		{
+			b->e=b->first?b->win:QMDDmultiplyParts(b->win,b->e); // window * QMDD for circuit to date
+			b->first=0;
+			b->wsize=0;
+		}
+	}
+}
+
+static void QMDDbuildFinish(CircuitBuild *b)
+// multiply the remaining window or parts in; b->e is the circuit QMDD then
+{
+	if(b->wsize) // last (partial) window
+	{
+		b->e=b->first?b->win:QMDDmultiplyParts(b->win,b->e);
+		b->first=0;
+		b->wsize=0;
+	}
+	if(b->parts)
+	{
+		while(b->parts>1)
+		{
+			b->part[b->parts-2]=QMDDmultiplyParts(b->part[b->parts-1],b->part[b->parts-2]);
+			b->parts--;
+		}
+		b->e=b->part[0];
+		b->first=0;
+		b->parts=0;
+	}
+}
+
 QMDDrevlibDescription QMDDcircuitRevlib(char *fname,QMDDrevlibDescription firstCirc, int match)
 // reads a circuit in Revlib format: http://www.revlib.org/documentation.php 
+//
+// the gate QMDDs are multiplied in windows of QMDDbuildWindow gates, each window
+// product is multiplied onto the circuit QMDD (1: gate by gate from left to right)
+// if QMDDbuildWindow is 0, they are multiplied pairwise in a balanced binary tree
+//
+// if QMDDfuseMax>0, runs of consecutive gates that act on at most QMDDfuseMax
+// lines together are multiplied with each other first and enter the circuit
+// QMDD as one gate (the gate QMDDs span all lines, with identity on the lines
+// the run does not touch, so their products stay small)
 {
 	FILE *infile;
 
 	QMDDrevlibDescription circ;
 
-	int first,i,j,k,p,t,line[MAXN],order[MAXN],invorder[MAXN];
-	char ch,tOutput[MAXSTRLEN],flag[MAXN],*cp,*cq,*cr;
+	int i,j,k;
 	CircuitLine tline;
 
-	QMDDedge e,f,olde;
+	QMDDedge f,fused;
+	CircuitBuild build;
+	char fusedline[MAXN];
+	int g,nfused;
+	TextLines gates;
 
 
 	// get name of input file, open it and attach it to file (a global)
@@ -393,41 +512,51 @@ QMDDrevlibDescription QMDDcircuitRevlib(char *fname,QMDDrevlibDescription firstC
 				circ.line[i]=circ.line[j];
 				circ.line[j]=tline;
 			}
+		QMDDhashLabels(&circ); // lines have moved, rehash their variable names
 	}
 
 
-	first=1;
-	e = QMDDident(0,circ.n);
+	build.first=1;
+	build.e = QMDDident(0,circ.n);
+	build.wsize=build.parts=0;
+	nfused=0;
+	readTextLines(infile,&gates); // all gate lines at once
 
-	while(1) // read gates
+	for(g=0;g<gates.n;g++) // build gates
 	{
 
-		f=QMDDreadGate(infile,&circ);
+		f=QMDDreadGateFromString(gates.line[g],&circ);
 		if(f.p==NULL) break;
+		QMDDincref(f);
 
-		if(first) // first gate in circuit
-		{
-			first = 0;
-			e=f;
-			QMDDincref(e);
-		}
-		else // second and subsequent gates
+		if(QMDDfuseMax>0)
 		{
-			olde=e;
-			e=QMDDmultiply(f,e); // multiply QMDD for gate * QMDD for circuit to date
-
-			QMDDincref(e);
-			QMDDdecref(olde);
+			k=0; // no. of lines of the fused gates if f is added
+			for(i=0;i<circ.n;i++) k+=(nfused&&fusedline[i])||circ.gateline[i];
+			if(nfused&&k<=QMDDfuseMax)
+			{
+				fused=QMDDmultiplyParts(f,fused);
+				nfused++;
+			} else {
+				if(nfused) QMDDbuildGate(&build,fused);
+				fused=f;
+				nfused=1;
+				for(i=0;i<circ.n;i++) fusedline[i]=0;
+			}
+			for(i=0;i<circ.n;i++) fusedline[i]|=circ.gateline[i];
 		}
+		else QMDDbuildGate(&build,f);
 		if(GCswitch) QMDDgarbageCollect();
 		
 	}
+	if(nfused) QMDDbuildGate(&build,fused);
+	QMDDbuildFinish(&build);
 
 	for(i=0;i<circ.n;i++) circ.outperm[i]=i;
 
-	skip2eof(infile); // skip rest of input file
+	freeTextLines(&gates);
 
-	circ.e=e;
+	circ.e=build.e;
 
 	i=0;
 	if(circ.ngate) circ.kind[i++]='N';
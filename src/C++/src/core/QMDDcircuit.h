@@ -15,7 +15,9 @@
     Routines            
 *****************************************************************/
 
-int getlabel(char*,QMDDrevlibDescription,int*);
+void QMDDhashLabels(QMDDrevlibDescription*);
+int QMDDfindLabel(const char*,QMDDrevlibDescription*);
+int getlabel(char*,QMDDrevlibDescription*,int*);
 
 QMDDedge QMDDreadGateFromString(char*, QMDDrevlibDescription*);
 QMDDedge QMDDreadGate(FILE*,QMDDrevlibDescription*);
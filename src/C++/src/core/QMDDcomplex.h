@@ -73,7 +73,13 @@ void QMDDcomplexInit(void); // initialization
 
 
 void QMDDcvalue_table_list(void); // print the complex value table entries
+void QMDDcomplexStatistics(void); // print complex table size and operation cache hit ratios
 int Clookup(complex); // lookup a complex value in the complex value table; if not found add it
+int Ctablesize(void); // number of slots in the complex value table (all indices are below this value)
+
+void Cincref(int); // increment reference count of a complex table entry
+void Cdecref(int); // decrement reference count of a complex table entry
+void QMDDcomplexGarbageCollect(void); // reclaim complex table entries that are no longer referenced
 
 complex Conj(complex); /// return complex conjugate
 
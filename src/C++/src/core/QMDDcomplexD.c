@@ -20,55 +20,127 @@ stored in a lookup table.
 The value 0 is always in slot 0 and the value 1 is always in slot
 1 so that for those two values the index corresponds to the value.
 
-Current implementation uses simple linear searching to find a value.
+Values are found through a hash index. The real and imaginary
+parts are quantized to a grid of cells of width 2*Ctol and each
+value is hashed by its cell. A stored value that is equal to c
+within tolerance lies either in the cell of c or in the neighbour
+cell on the side c is closer to (in each direction), so a lookup
+probes at most four collision chains, starting with the cell of c.
+
+Results of Cadd, Csub, Cmul and Cdiv are kept in a direct-mapped
+operation cache keyed on (operation, index a, index b), so repeated
+arithmetic on the same weights is a single cache probe.
+
+The table starts with COMPLEXTSIZE slots and grows by chunks of
+CCHUNK entries whenever it is full; chunks never move, so an entry
+can be read while other entries are added. Every entry has a
+reference count that QMDDincref/QMDDdecref maintain for the weights
+of the edges they are called on, so an entry is referenced as long
+as a root edge or an edge of a live node carries it.
+QMDDgarbageCollect invokes QMDDcomplexGarbageCollect which puts
+unreferenced entries on a free list for reuse (weights held by the
+compute tables are referenced for the duration of the call).
+Renormalization factors are only non-trivial during reordering,
+where no garbage collection takes place, so they are not counted.
+
+While QMDDparallel is set (parallel QMDD operations, PARALLEL=openmp),
+the hash chains and the operation cache slots are guarded by CLOCKS
+lock stripes each; a lookup takes the stripes of the (at most four)
+chains it probes. Allocating an entry takes one more lock. Values,
+magnitudes and angles of entries are read without locking, and the
+hash index is only enlarged outside parallel operations.
+
+This is the native package. QMDDcomplexJL.c provides the same
+routines by calling into Julia; the makefile selects one of the
+two (COMPLEX=native, the default, or COMPLEX=julia).
 
 QMDDinit (in QMDDpackage.c which is the initialization routine that
 must be called before the other package routines are used) invokes 
-QMDDinitCtable()
+QMDDcomplexInit()
 
 *****************************************************************/
 
 #define DEFINE_COMPLEX_H_VARIABLES
 #include "QMDDcomplex.h"
-#include <julia.h>
-#include <julia_threads.h>
+
+#define CLOCKS 64		// lock stripes of the hash index and of the operation cache; must be a power of 2
+
+#ifdef _OPENMP
+#include <omp.h>
+// locks for parallel operations, taken only while QMDDparallel is set
+// (hash chain stripes in ascending order, then CallocLock)
+static omp_lock_t ChLock[CLOCKS];	// hash bucket k is guarded by ChLock[k&(CLOCKS-1)]
+static omp_lock_t CCLock[CLOCKS];	// operation cache slot s is guarded by CCLock[s&(CLOCKS-1)]
+static omp_lock_t CallocLock;		// free list and chunk allocation
+#define Clock_set(l) if(QMDDparallel) omp_set_lock(&(l))
+#define Clock_unset(l) if(QMDDparallel) omp_unset_lock(&(l))
+#else
+#define Clock_set(l)
+#define Clock_unset(l)
+#endif
 
 void QMDDpause(void);
 
-complex gCvalue(int ai)
-{
-  complex ret;
+#define CHASHBUCKETS 4096	// initial no. of buckets of the complex value hash index; must be a power of 2
+#define CPINNED 3		// entries 0, 1 and -1 (slots 0, 1, 2) are never reclaimed
 
-  jl_function_t *f = jl_get_function(jl_current_module,"gCvalue");
-  jl_value_t *a1 = jl_box_int32(ai);
-  jl_array_t *v1 = (jl_array_t *) jl_call1(f,a1);
-  long double *xval = (long double *) jl_array_data(v1);
-  ret.r = xval[0];
-  ret.i = xval[1];
+/***************************************
 
-  return ret; 
-}
+	Complex Value Lookup Table
 
-int Clookup(complex c)
+***************************************/
+
+static long double Ctol = 1.0e-10;	// tolerance for testing equality of complex values
+
+#define CCHUNKSHIFT 14			// the table is allocated in chunks of CCHUNK entries
+#define CCHUNK (1<<CCHUNKSHIFT)
+#define CMAXCHUNKS ((1<<(31-CCHUNKSHIFT))-1)	// keeps all indices within int
+
+typedef struct Centry // complex table entry
 {
-  int ret;
-  jl_value_t *ar_t = jl_apply_array_type(jl_float64_type, 1);
-  jl_array_t *x = jl_alloc_array_1d(ar_t, 2);
-  JL_GC_PUSH1(&x);
+  complex v;			// value
+  long double mag;		// magnitude to avoid repeated computation
+  long double angle;		// angle to avoid repeated computation
+  int next;			// next entry in the same hash bucket (-1 ends the chain)
+  int ref;			// reference count (-1 marks a free slot)
+} Centry;
 
-  double *xData = (double *) jl_array_data(x);
-  
-  xData[0] = c.r;
-  xData[1] = c.i;
+static int Csize;			// number of slots in the complex table (grows on demand)
+static int Ctentries;			// number of slots used so far (in use or on the free list)
+static int Cused;			// number of complex table entries in use
+static int Cfree;			// first slot of the free list (-1 if empty), linked through Cent().next
+static long Creclaimed;			// number of entries reclaimed by garbage collection
+static Centry *Cchunk[CMAXCHUNKS];	// chunks of the table (Csize/CCHUNK of them are allocated)
+static int *Chash;			// first entry of each hash bucket (-1 if empty)
+static int Chashsize;			// number of hash buckets; a power of 2
+static int CTa[MAXRADIX];		// complex table positions for roots of unity
+
+#define Cent(x) Cchunk[(x)>>CCHUNKSHIFT][(x)&(CCHUNK-1)]
+#define Cvalue(x) Cent(x).v
+
+#define Ceq(x,y) ((fabsl((x.r)-(y.r))<Ctol)&&(fabsl((x.i)-(y.i))<Ctol))
+
+#define CGRID (2*Ctol)  // width of a grid cell of the hash index
+#define CMAXCELL 4.0e18L  // cells beyond +-CMAXCELL are merged, so cell numbers fit into long long
+
+/*********************************************
 
-  jl_function_t *f = jl_get_function(jl_current_module,"Clookup1");
-  jl_value_t *rr = jl_call1(f, (jl_value_t *)x);
-  ret = jl_unbox_int32(rr);
+Complex operation cache. Saves the result of
+operations over complex table indices to avoid
+recomputation later.
 
-  JL_GC_POP();
+*********************************************/
 
-  return ret;
-} 
+typedef enum{Caddop,Csubop,Cmulop,Cdivop} CCkind; // operation cache entry kinds
+
+typedef struct CCentry // operation cache entry defn
+{
+  int a,b,r;		// a and b are arguments, r is the result
+  CCkind which;		// type of operation
+} CCentry;
+
+static CCentry CCtable[CCSLOTS];
+static long CClook[CLOCKS][4],CChit[CLOCKS][4];	// counters for gathering operation cache hit stats (per lock stripe)
 
 /**************************************
 
@@ -93,36 +165,25 @@ void Cprint(complex c)
 	std::ostringstream oss;
 	Cprint(c, oss);
 	std::cout << oss.str();  
-  /*if(c.r==1.0) printf("1"); else if(c.r==0.0) printf("0"); else printf("%f",c.r);
-  if(c.i>0.0) printf("+");
-  if(c.i!=0.0) printf("%fi ",c.i);*/
 }
 
-double QMDDcos(double a, double b)
+complex gCvalue(int a)
+// value of table entry a
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"QMDDcos");
-  jl_value_t *v1 = jl_box_float64(a);
-  jl_value_t *v2 = jl_box_float64(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  return(Cvalue(a));
 }
 
-double QMDDsin(double a, double b)
+long double angle(int a)
+// computes angle for polar coordinate representation of Cvalue(a)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"QMDDsin");
-  jl_value_t *v1 = jl_box_float64(a);
-  jl_value_t *v2 = jl_box_float64(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
-}
-
-int Ceq(int a, int b)
-{  
-  jl_function_t *f = jl_get_function(jl_current_module,"Ceq");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex ca;
+  long double m;
+
+  ca=Cvalue(a);
+  m=Cent(a).mag;
+  if(m==0) return(0);
+  if(ca.i>=0-Ctol) return(acosl(ca.r/m));
+  else return(2*Pi-acosl(ca.r/m));
 }
 
 int Cgt(int a, int b)
@@ -131,30 +192,40 @@ int Cgt(int a, int b)
 // returns angle(a)<angle(b)
 // where angle is the angle in polar coordinate representation
 {  
-  jl_function_t *f = jl_get_function(jl_current_module,"Cgt");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
-}
-
-int Cgt_new(int a, int b)
-{  
-  jl_function_t *f = jl_get_function(jl_current_module,"Cgt_new");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  long double ma,mb,aa,ab;
+
+  if(a==b) return(0);
+
+  /// BETA: 121017
+  // returns the smaller nonzero value
+  if (a == 0)
+    return(1);
+  if (b == 0)
+    return(0);
+
+  ma=Cent(a).mag;
+  mb=Cent(b).mag;
+  aa=Cent(a).angle;
+  ab=Cent(b).angle;
+  if(ma>(mb+Ctol)) return(1);
+  if(mb>(ma+Ctol)) return(0);
+  //CHANGED by pN 120831
+  return((aa+Ctol)<ab);
 }
 
 int Clt(int a, int b)
 // analogous to Cgt
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Clt");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  long double ma,mb,aa,ab;
+
+  if(a==b) return(0);
+  ma=Cent(a).mag;
+  mb=Cent(b).mag;
+  aa=Cent(a).angle;
+  ab=Cent(b).angle;
+  if(ma<(mb+Ctol)) return(1);
+  if(mb<(ma+Ctol)) return(0);
+  return((aa+Ctol)>ab);
 }
 
 complex Cmake(long double r,long double i)
@@ -187,22 +258,347 @@ long double Qmake(int a, int b,int c)
 // required to be compatible with quadratic irrational-based 
 // complex number package
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Qmake");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(b);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  return(((long double)a+((long double)b)*sqrtl(2.0))/(long double)(c));
+}
+
+double QMDDcos(double fac, double div)
+// cosine of the angle fac*Pi/div
+{
+  return(cosl((long double)fac*Pi/(long double)div));
+}
+
+double QMDDsin(double fac, double div)
+// sine of the angle fac*Pi/div
+{
+  return(sinl((long double)fac*Pi/(long double)div));
+}
+
+static long double Cgrid(long double x)
+// position of x in units of grid cells, clamped to +-CMAXCELL (NaN to -CMAXCELL)
+{
+  x/=CGRID;
+  if(!(x>-CMAXCELL)) return(-CMAXCELL);
+  if(x>CMAXCELL) return(CMAXCELL);
+  return(x);
+}
+
+static int Cbucket(long long cr,long long ci)
+// hash bucket of grid cell (cr,ci)
+{
+  unsigned long long h;
+
+  h=(unsigned long long)cr*0x9E3779B97F4A7C15ULL^(unsigned long long)ci*0xC2B2AE3D27D4EB4FULL;
+  return((int)((h^(h>>32))&(Chashsize-1)));
+}
+
+static void Crehash(int size)
+// rebuild the hash index with size buckets from the entries in use
+{
+  int i,k;
+
+  free(Chash);
+  Chashsize=size;
+  Chash=(int*)malloc(Chashsize*sizeof(int));
+  if(Chash==NULL) throwException("Complex table hash index allocation failed\n",1);
+  for(i=0;i<Chashsize;i++)
+    Chash[i]=-1;
+  for(i=0;i<Ctentries;i++)
+    if(Cent(i).ref>=0)
+    {
+      k=Cbucket((long long)floorl(Cgrid(Cent(i).v.r)),(long long)floorl(Cgrid(Cent(i).v.i)));
+      Cent(i).next=Chash[k];
+      Chash[k]=i;
+    }
+}
+
+static void Cresize(int size)
+// allocate chunks until the complex table has at least size slots
+// (entries already in the table stay where they are)
+{
+  int c;
+
+  while(Csize<size)
+  {
+    c=Csize>>CCHUNKSHIFT;
+    if(c==CMAXCHUNKS) throwException("Complex table full\n",1);
+    Cchunk[c]=(Centry*)malloc(CCHUNK*sizeof(Centry));
+    if(Cchunk[c]==NULL) throwException("Complex table allocation failed\n",1);
+    Csize+=CCHUNK;
+  }
+}
+
+void QMDDinitCtable(void)
+// initialize the complex value table and its hash index to empty
+// (chunks allocated by an earlier initialization are reused)
+{
+  int i,j;
+
+  Ctentries=Cused=0;
+  Cfree=-1;
+  Creclaimed=0;
+  Cresize(COMPLEXTSIZE);
+  Crehash(CHASHBUCKETS);
+  for(i=0;i<CCSLOTS;i++)
+    CCtable[i].a=-1;
+  for(i=0;i<CLOCKS;i++)
+    for(j=0;j<4;j++)
+      CClook[i][j]=CChit[i][j]=0;
+
+  if(VERBOSE) printf("\nDouble complex number package initialized\n\n");
 }
 
 void QMDDcomplexInit(void)
 // initialization
 {
-  jl_eval_string("QMDDinitComplex()");
+#ifdef _OPENMP
+  static int lockInit=0;
+  int i;
+
+  if(!lockInit)
+  {
+    for(i=0;i<CLOCKS;i++)
+    {
+      omp_init_lock(&ChLock[i]);
+      omp_init_lock(&CCLock[i]);
+    }
+    omp_init_lock(&CallocLock);
+  }
+  lockInit=1;
+#endif
+  Ctol=1.0e-10;
+  QMDDinitCtable();
 }
 
 void QMDDcvalue_table_list(void)
 // print the complex value table entries
 {
+  int i;
+
+  printf("\nComplex value table: %d entries\n",Cused);
+  std::cout << "index value Magnitude Angle 1) radian 2) degree" << std::endl;
+  for(i=0;i<Ctentries;i++)
+  {
+    if(Cent(i).ref<0) continue; // free slot
+    std::cout << i << " ";
+    Cprint(Cent(i).v);
+    if(i!=0&&i%100==0) QMDDpause();
+    std::cout << " || " << Cent(i).mag<< " " << Cent(i).angle;
+    std::cout << " " <<(Cent(i).angle*180/Pi) << std::endl;
+  }
+}
+
+static int Csearch(int k,complex c)
+// search collision chain k for a value equal to c within tolerance
+// returns -1 if there is none
+{
+  int i;
+
+  for(i=Chash[k];i>=0;i=Cent(i).next)
+    if(Ceq(Cent(i).v,c)) return(i);
+  return(-1);
+}
+
+#ifdef _OPENMP
+static int Cstripes(int b[4],int st[4])
+// distinct lock stripes of the hash buckets b[0..3] in ascending order, returns their number
+{
+  int i,j,n,x;
+
+  n=0;
+  for(i=0;i<4;i++)
+  {
+    x=b[i]&(CLOCKS-1);
+    for(j=n;j>0&&st[j-1]>x;j--) ;
+    if(j>0&&st[j-1]==x) continue;
+    memmove(&st[j+1],&st[j],(n-j)*sizeof(int));
+    st[j]=x;
+    n++;
+  }
+  return(n);
+}
+#endif
+
+int Clookup(complex c)
+// lookup a complex value in the complex value table
+// if not found add it
+{
+  int i,j,b[4];
+  long double fr,fi;
+  long long cr,ci,nr,ni;
+#ifdef _OPENMP
+  int st[4],nst=0;
+#endif
+
+  fr=Cgrid(c.r);
+  fi=Cgrid(c.i);
+  cr=(long long)floorl(fr);  // cell of c
+  ci=(long long)floorl(fi);
+  nr=(fr-cr<0.5)?cr-1:cr+1;  // neighbour cells within tolerance of c
+  ni=(fi-ci<0.5)?ci-1:ci+1;
+  b[0]=Cbucket(cr,ci);
+  b[1]=Cbucket(nr,ci);
+  b[2]=Cbucket(cr,ni);
+  b[3]=Cbucket(nr,ni);
+
+#ifdef _OPENMP
+  if(QMDDparallel)  // the stripes of all probed chains, so that no equal value is added meanwhile
+  {
+    nst=Cstripes(b,st);
+    for(j=0;j<nst;j++) omp_set_lock(&ChLock[st[j]]);
+  }
+#endif
+  for(j=0;j<4;j++)
+    if((i=Csearch(b[j],c))>=0) break;
+
+  if(j==4)  // not found: add it
+  {
+    Clock_set(CallocLock);
+    if(Cfree>=0)  // reuse a reclaimed slot if possible
+    {
+      i=Cfree;
+      Cfree=Cent(i).next;
+    } else {  // otherwise take a new one, adding a chunk if the table is full
+      if(Ctentries==Csize) Cresize(Csize+1);
+      i=Ctentries++;
+    }
+    Cused++;
+    Clock_unset(CallocLock);
+    Cent(i).v=c;
+    Cent(i).mag=sqrtl(c.r*c.r+c.i*c.i);
+    Cent(i).angle=angle(i);
+    Cent(i).ref=0;
+
+    Cent(i).next=Chash[b[0]];  // add it to front of collision chain
+    Chash[b[0]]=i;
+  }
+#ifdef _OPENMP
+  for(j=0;j<nst;j++) omp_unset_lock(&ChLock[st[j]]);
+#endif
+  if(!QMDDparallel&&Cused>Chashsize) Crehash(2*Chashsize); // keep chains short
+  return(i);
+}
+
+static int CChash(int a,int b,CCkind which)
+// operation cache slot for (which,a,b)
+{
+  unsigned int h;
+
+  h=((unsigned int)a*0x9E3779B1u)^((unsigned int)b*0x85EBCA77u)^(unsigned int)which;
+  return((int)((h^(h>>15))&CCMASK));
+}
+
+static int CClookup(int a,int b,CCkind which)
+// lookup an operation in the operation cache
+// return -1 if not a match else returns result of prior computation
+{
+  CCentry *t;
+  int k,r;
+
+  k=CChash(a,b,which);
+  t=&CCtable[k];
+  k&=CLOCKS-1;
+  Clock_set(CCLock[k]);
+  CClook[k][which]++;
+  if(t->a!=a||t->b!=b||t->which!=which) r=-1;
+  else
+  {
+    CChit[k][which]++;
+    r=t->r;
+  }
+  Clock_unset(CCLock[k]);
+  return(r);
+}
+
+static int CCinsert(int a,int b,int r,CCkind which)
+// put an entry into the operation cache and return the result r
+{
+  CCentry *t;
+  int k;
+
+  k=CChash(a,b,which);
+  t=&CCtable[k];
+  k&=CLOCKS-1;
+  Clock_set(CCLock[k]);
+  t->a=a;
+  t->b=b;
+  t->r=r;
+  t->which=which;
+  Clock_unset(CCLock[k]);
+  return(r);
+}
+
+void QMDDcomplexStatistics(void)
+// displays complex number package statistics
+{
+  const char *name[4]={"addition","subtraction","multiplication","division"};
+  long look,hit;
+  int i,k;
+
+  printf("Complex table entries: %d in use, %d slots, %ld reclaimed\n",Cused,Csize,Creclaimed);
+  printf("Complex operation cache hit ratios:\n");
+  for(i=0;i<4;i++)
+  {
+    for(k=look=hit=0;k<CLOCKS;k++)
+    {
+      look+=CClook[k][i];
+      hit+=CChit[k][i];
+    }
+    printf("%s %ld/%ld (%ld misses) %5.2f per cent\n",name[i],hit,look,look-hit,
+          look?(float)hit/look*100:0.0);
+  }
+}
+
+int Ctablesize(void)
+// number of slots in the complex value table
+// all table indices are below this value
+{
+  return(Csize);
+}
+
+void Cincref(int a)
+// increment reference count of table entry a
+{
+  Cent(a).ref++;
+}
+
+void Cdecref(int a)
+// decrement reference count of table entry a
+{
+  Cent(a).ref--;
+}
+
+void QMDDcomplexGarbageCollect(void)
+// put all unreferenced table entries on the free list and remove them
+// from the hash index and the operation cache
+{
+  int i,count;
+  CCentry *t;
+
+  count=0;
+  for(i=CPINNED;i<Ctentries;i++)
+    if(Cent(i).ref==0)
+    {
+      Cent(i).ref=-1;
+      count++;
+    }
+  if(count==0) return;
+  Cused-=count;
+  Creclaimed+=count;
+
+  Crehash(Chashsize);  // relinks entries in use only
+  Cfree=-1;
+  for(i=Ctentries-1;i>=CPINNED;i--)
+    if(Cent(i).ref<0)
+    {
+      Cent(i).next=Cfree;
+      Cfree=i;
+    }
+
+  for(i=0;i<CCSLOTS;i++)
+  {
+    t=&CCtable[i];
+    if(t->a>=0&&(Cent(t->a).ref<0||Cent(t->b).ref<0||Cent(t->r).ref<0)) t->a=-1;
+  }
 }
 
 complex Conj(complex c)
@@ -212,6 +608,7 @@ complex Conj(complex c)
   return(c);
 }
 
+
 // basic operations on complex values
 // meanings are self-evident from the names
 // NOTE arguments are the indices to the values 
@@ -219,77 +616,142 @@ complex Conj(complex c)
 
 int Cnegative(int a)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Cnegative");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *ret = jl_call1(f,v1);
-  return jl_unbox_float64(ret);
+  complex c;
+  c=gCvalue(a);
+  c.r=-c.r;
+  c.i=-c.i;
+  return(Clookup(c));
 }
 
 int Cadd(int ai,int bi)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Cadd");
-  jl_value_t *v1 = jl_box_int32(ai);
-  jl_value_t *v2 = jl_box_int32(bi);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex a,b,r;
+
+  int t;
+
+  if(ai==0) return(bi); // identity cases
+  if(bi==0) return(ai);
+  if(ai>bi) {t=ai; ai=bi; bi=t;} // addition commutes, so cache only one order
+
+  if(0>(t=CClookup(ai,bi,Caddop))) // look in operation cache
+  {
+    a=Cvalue(ai); // if new compute result
+    b=Cvalue(bi);
+    r.r=a.r+b.r;
+    r.i=a.i+b.i;
+    t=CCinsert(ai,bi,Clookup(r),Caddop); // save result
+  }
+  return(t);
 }
 
 int Csub(int ai,int bi)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Csub");
-  jl_value_t *v1 = jl_box_int32(ai);
-  jl_value_t *v2 = jl_box_int32(bi);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex a,b,r;
+
+  int t;
+
+  if(bi==0) return(ai); // identity case
+
+  if(0>(t=CClookup(ai,bi,Csubop))) // look in operation cache
+  {
+    a=Cvalue(ai); // if new compute result
+    b=Cvalue(bi);
+    r.r=a.r-b.r;
+    r.i=a.i-b.i;
+    t=CCinsert(ai,bi,Clookup(r),Csubop); // save result
+  }
+  return(t);
 }
 
 int Cmul(int ai,int bi)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Cmul");
-  jl_value_t *v1 = jl_box_int32(ai);
-  jl_value_t *v2 = jl_box_int32(bi);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex a,b,r;
+
+  int t;
+
+  if(ai==1) return(bi); // identity cases
+  if(bi==1) return(ai);
+  if(ai==0||bi==0) return(0);
+  if(ai>bi) {t=ai; ai=bi; bi=t;} // multiplication commutes, so cache only one order
+
+  if(0>(t=CClookup(ai,bi,Cmulop))) // look in operation cache
+  {
+    a=Cvalue(ai); // if new compute result
+    b=Cvalue(bi);
+    r.r=a.r*b.r-a.i*b.i;
+    r.i=a.r*b.i+a.i*b.r;
+    t=CCinsert(ai,bi,Clookup(r),Cmulop); // save result
+  }
+  return(t);
 }
 
 int CintMul(int a,int bi)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"CintMul");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *v2 = jl_box_int32(bi);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex r;
+  r=gCvalue(bi);
+  r.r*=a;
+  r.i*=a;
+  return(Clookup(r));
 }
 
 int Cdiv(int ai,int bi)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"Cdiv");
-  jl_value_t *v1 = jl_box_int32(ai);
-  jl_value_t *v2 = jl_box_int32(bi);
-  jl_value_t *ret = jl_call2(f,v1,v2);
-  return jl_unbox_float64(ret);
+  complex a,b,r;
+  long double d;
+  int t;
+
+  if(ai==bi) return(1); // equal case
+  if(ai==0) return(0); // identity cases
+  if(bi==1) return(ai);
+
+  if(0>(t=CClookup(ai,bi,Cdivop))) // check operation cache
+  {
+    a=Cvalue(ai); // if new compute result
+    b=Cvalue(bi);
+    if(b.i==0.0)
+    {
+      r.r=a.r/b.r;
+      r.i=a.i/b.r;
+    } else {
+      d=b.r*b.r+b.i*b.i;
+      r.r=(a.r*b.r+a.i*b.i)/d;
+      r.i=(a.i*b.r-a.r*b.i)/d;
+    }
+    t=CCinsert(ai,bi,Clookup(r),Cdivop); // save result
+  }
+  return(t);
 }
 
 void QMDDmakeRootsOfUnity(void)
 {
-  jl_eval_string("QMDDmakeRootsOfUnity()");
+  int i;
+  CTa[0]=1;
+  CTa[1]=Clookup(Cmake(cosl(2*Pi/Radix),sinl(2*Pi/Radix)));
+  for(i=2;i<Radix;i++)
+    CTa[i]=Cmul(CTa[i-1],CTa[1]);
 }
 
 /// by PN: returns the absolut value of a complex number
 int CAbs(int a)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"CAbs");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *ret = jl_call1(f,v1);
-  return jl_unbox_float64(ret);
+  long double m;
+
+  if (a<2) return a; // trivial cases 0/1
+
+  m=Cent(a).mag; // magnitude kept with the table entry
+  return(Clookup(Cmake(m,0)));
 }
 
 ///by PN: returns whether a complex number has norm 1
 int CUnit(int a)
 {
-  jl_function_t *f = jl_get_function(jl_current_module,"CUnit");
-  jl_value_t *v1 = jl_box_int32(a);
-  jl_value_t *ret = jl_call1(f,v1);
-  return jl_unbox_float64(ret);
-}
+ int t;
+
+ /// BETA 121017
 
+ if (a<2)
+   return a;
+
+ t=(Cent(a).mag < 1-Ctol)?0:1;
+ return t;
+}
@@ -13,9 +13,29 @@ QMDD package routines
 *********************************************/
 
 #define DEFINE_VARIABLES	// not only declare, but DEFINE global variables
-#include <julia.h>
-#include <julia_threads.h>
 #include "QMDDpackage.h"
+#include "timing.h"
+#include <sys/mman.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+// locks for parallel operations, taken only while QMDDparallel is set
+// (a unique table lock may be held while NodeLock is taken, not the other way round)
+static omp_lock_t UTlock[MAXN],NodeLock,CTlock[CTLOCKS];
+#define QMDDlock(l) if(QMDDparallel) omp_set_lock(&(l))
+#define QMDDunlock(l) if(QMDDparallel) omp_unset_lock(&(l))
+// statistics counters shared by the tasks are incremented atomically
+#define QMDDcount(c) do { if(QMDDparallel) { _Pragma("omp atomic") (c)++; } else (c)++; } while(0)
+static int QMDDparLevel;	// QMDDmultiply2 and QMDDadd2 spawn tasks for more than this many variables
+#else
+#define QMDDlock(l)
+#define QMDDunlock(l)
+#define QMDDcount(c) (c)++
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 
 
 /***********************************************
@@ -84,29 +104,49 @@ void QMDDdebugnode(QMDDnodeptr p)
 }
 
 
+typedef struct ListBlock // block of list elements for breadth first traversals
+{
+  struct ListBlock *next;
+  ListElement e[LISTBLOCK];
+} ListBlock;
+
+static ListBlock *Lblocks;	// list element blocks in use by the current traversal
+
 ListElementPtr QMDDnewListElement(void)
 {
-  ListElementPtr r,r2;
-  int i,j;
+  ListElementPtr r;
+  ListBlock *b;
+  int i;
       
-  if(Lavail!=NULL)	// get node from avail chain if possible
+  if(Lavail==NULL)	// allocate a new block if avail chain is empty
   {
-	r=Lavail;
-	Lavail=Lavail->next;
-  } else {			// otherwise allocate 2000 new nodes
-  j=sizeof(ListElement);;
-  r=(ListElementPtr)malloc(2000*j);
-  r2=(ListElementPtr)((long)r+j);
-  Lavail=r2;
-  for(i=0;i<1998;i++,r2=(ListElementPtr)((long)r2+j))
-  {
-    r2->next=(ListElementPtr)((long)r2+j);
-  }
-     r2->next=NULL;
+    b=(ListBlock *)malloc(sizeof(ListBlock));
+    if(b==NULL) throwException("QMDDnewListElement: out of memory", 1);
+    b->next=Lblocks;
+    Lblocks=b;
+    for(i=0;i<LISTBLOCK-1;i++) b->e[i].next=&b->e[i+1];
+    b->e[LISTBLOCK-1].next=NULL;
+    Lavail=&b->e[0];
   }
+  r=Lavail;
+  Lavail=Lavail->next;
   return(r);
 }
 
+void QMDDfreeListElements(void)
+// release all list elements at the end of a traversal
+{
+  ListBlock *b;
+  
+  while(Lblocks!=NULL)
+  {
+    b=Lblocks;
+    Lblocks=b->next;
+    free(b);
+  }
+  Lavail=NULL;
+}
+
 void QMDDprint(QMDDedge e,int limit)
 // a slightly better QMDD print utility
 {
@@ -178,10 +218,12 @@ void QMDDprint(QMDDedge e,int limit)
     if(i==limit) 
     {
       printf("Printing terminated at %d vertices\n",limit);
+      QMDDfreeListElements();
       return;
     }  
 pnext=pnext->next; 
   }
+  QMDDfreeListElements();
 }
 
 QMDDedge QMDDextractColumn(int col[],QMDDedge a)
@@ -403,6 +445,7 @@ void QMDD2dot(QMDDedge e,int limit, std::ostream& oss, QMDDrevlibDescription cir
   }
  oss << nodes.str() << edges.str()
 	    << std::endl << "}" << std::endl;	
+  QMDDfreeListElements();
 }
 
 void QMDDdotExport(QMDDedge basic, int n, char outputFilename[], QMDDrevlibDescription circ, int show){
@@ -581,42 +624,227 @@ void QMDDcheckSpecialMatrices(QMDDedge e)
   return;
 }
 
+static int QMDDnodeChunks,QMDDnodeChunkSlots; // chunk table entries in use / allocated
+static int *QMDDchunkLive;	// no. of nodes of each chunk that are not on the avail chain
+static long QMDDchunksReleased;	// chunks given back to the system
+
+#ifdef QMDD_COMPACT_NODES
+#define NODECHUNKOF(p) ((p).handle()>>NODECHUNKSHIFT)
+#else
+#define NODECHUNKOF(p) ((p)->chunk)
+#endif
+
+#define NODECHUNKBYTES (NODECHUNK*sizeof(QMDDnode))
+
+static QMDDnodeptr QMDDnewNodeChunk(void)
+// map a chunk of NODECHUNK nodes and chain them together;
+// returns the first node of the chain
+{
+  QMDDnodeptr first;
+  QMDDnode *mem;
+  int c;
+  
+  for(c=0;c<QMDDnodeChunks;c++) // reuse the slot of a released chunk if possible
+    if(QMDDnodeChunk[c]==NULL) break;
+  if(c==QMDDnodeChunks)
+  {
+#ifdef QMDD_COMPACT_NODES
+    if((long)(c+1)<<NODECHUNKSHIFT>UINT32_MAX) throwException("QMDDgetNode: node handles exhausted", 1);
+#endif
+    if(QMDDnodeChunks==QMDDnodeChunkSlots)
+    {
+      QMDDnodeChunkSlots=QMDDnodeChunkSlots?2*QMDDnodeChunkSlots:64;
+      QMDDnodeChunk=(QMDDnode **)realloc(QMDDnodeChunk,QMDDnodeChunkSlots*sizeof(QMDDnode *));
+      QMDDchunkLive=(int *)realloc(QMDDchunkLive,QMDDnodeChunkSlots*sizeof(int));
+      if(QMDDnodeChunk==NULL||QMDDchunkLive==NULL) throwException("QMDDgetNode: out of memory", 1);
+    }
+    QMDDnodeChunks++;
+  }
+  // chunks are mapped directly so that munmap really returns them to the system
+  mem=(QMDDnode *)mmap(NULL,NODECHUNKBYTES,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if(mem==(QMDDnode *)MAP_FAILED) throwException("QMDDgetNode: out of memory", 1);
+  QMDDnodeChunk[c]=mem;
+  QMDDchunkLive[c]=0;
+#ifdef QMDD_COMPACT_NODES
+  uint32_t h;
+  
+  h=(uint32_t)c<<NODECHUNKSHIFT;
+  if(h==0) h=1; // handle 0 is the null handle
+  first=QMDDnodeptr(h);
+  for(;(h&(NODECHUNK-1))!=NODECHUNK-1;h++)
+    QMDDnodeptr(h)->next=QMDDnodeptr(h+1);
+  QMDDnodeptr(h)->next=NULL;
+#else
+  int i;
+  
+  for(i=0;i<NODECHUNK;i++)
+  {
+    mem[i].chunk=c;
+    mem[i].next=(i<NODECHUNK-1)?&mem[i+1]:NULL;
+  }
+  first=mem;
+#endif
+  return(first);
+}
+
+static void QMDDreleaseNodeChunks(void)
+// give chunks without live nodes back to the system
+// (their nodes are taken off the avail chain first)
+{
+  QMDDnodeptr p,lastp;
+  int c,empty;
+  
+  empty=0;
+  for(c=0;c<QMDDnodeChunks;c++)
+    if(QMDDnodeChunk[c]!=NULL&&QMDDchunkLive[c]==0) empty++;
+  if(empty==0) return;
+  
+  lastp=NULL;
+  for(p=Avail;p!=NULL;p=p->next)
+  {
+    if(QMDDchunkLive[NODECHUNKOF(p)]==0)
+    {
+      if(lastp==NULL) Avail=p->next;
+      else lastp->next=p->next;
+    }
+    else lastp=p;
+  }
+  for(c=0;c<QMDDnodeChunks;c++)
+    if(QMDDnodeChunk[c]!=NULL&&QMDDchunkLive[c]==0)
+    {
+      munmap(QMDDnodeChunk[c],NODECHUNKBYTES);
+      QMDDnodeChunk[c]=NULL;
+      QMDDchunksReleased++;
+    }
+}
+
+void QMDDfreeNode(QMDDnodeptr p)
+// put a node that is no longer in use on the available space chain
+{
+  QMDDlock(NodeLock);
+  p->next=Avail;
+  Avail=p;
+  QMDDchunkLive[NODECHUNKOF(p)]--;
+  QMDDunlock(NodeLock);
+}
+
+QMDDnodeptr QMDDgetNode(void)
+{
+// get memory space for a node
+//
+  QMDDnodeptr r;
+      
+  QMDDlock(NodeLock);
+  if(Avail==NULL) Avail=QMDDnewNodeChunk(); // get a new chunk if the avail chain is empty
+  r=Avail;
+  Avail=Avail->next;
+  QMDDchunkLive[NODECHUNKOF(r)]++;
+  QMDDunlock(NodeLock);
+  r->next=NULL;
+  r->ref=0;			// set reference count to 0
+  r->ident=r->diag=r->block=0;		// mark as not identity or diagonal
+  return(r);
+}
+
+static unsigned long UThash(QMDDnodeptr p)
+// hash value of a node for the unique table (before masking)
+{
+  uint64_t key;
+  int i;
+  
+  key=0;
+// each (pointer,weight) pair is mixed into the key by a multiplication so that
+// the order of the edges matters and all bits of the pointers contribute;
+// the low bits (used as bucket index) are taken from the well-mixed high half
+  for(i=0;i<Nedge;i++)
+  {
+    key=(key^(uint64_t)(intptr_t)p->e[i].p)*UINT64_C(0x9E3779B97F4A7C15);
+    key=(key^p->e[i].w)*UINT64_C(0xC2B2AE3D27D4EB4F);
+  }
+  return((unsigned long)(key^(key>>32)));
+}
+
+static inline int UTmatchEdges(QMDDnodeptr p,QMDDnodeptr q)
+// compares the edges of two nodes, stopping at the first difference
+{
+  int i;
+  
+  for(i=0;i<Nedge;i++)
+    if(p->e[i].p!=q->e[i].p||p->e[i].w!=q->e[i].w) return(0);
+  return(1);
+}
+
+void QMDDutResize(int v,int nbucket)
+// rehash the unique table for variable v into nbucket buckets (a power of 2)
+{
+  QMDDnodeptr *old,p,pnext;
+  int oldn,j;
+  unsigned long key;
+  
+  old=Unique[v].bucket;
+  oldn=Unique[v].nbucket;
+  Unique[v].bucket=(QMDDnodeptr *)calloc(nbucket,sizeof(QMDDnodeptr));
+  if(Unique[v].bucket==NULL) throwException("QMDDutResize: out of memory", 1);
+  Unique[v].nbucket=nbucket;
+  for(j=0;j<oldn;j++)
+    for(p=old[j];p!=NULL;p=pnext)
+    {
+      pnext=p->next;
+      key=p->hash&(nbucket-1);
+      p->next=Unique[v].bucket[key];
+      Unique[v].bucket[key]=p;
+    }
+  free(old);
+}
+
+void QMDDutInsert(QMDDnodeptr p)
+// put node p into the unique table of its variable without searching for a match
+// (used when nodes are moved between tables, e.g. by QMDDswap)
+// p->hash must be valid for the current edges of p
+{
+  unsigned long key;
+  UTable *ut;
+  
+  ut=&Unique[p->v];
+  if(ut->nodes>=(long)ut->nbucket*UTMAXLOAD) QMDDutResize(p->v,2*ut->nbucket);
+  key=p->hash&(ut->nbucket-1);
+  p->next=ut->bucket[key];
+  ut->bucket[key]=p;
+  ut->nodes++;
+  if(p->ref==0) ut->dead++;
+}
+
 QMDDedge QMDDutLookup(QMDDedge e)
 {
 //  lookup a node in the unique table for the appropriate variable - if not found insert it
 //  only normalized nodes shall be stored.
 
-  intptr_t key;
-  int i,j;
-  unsigned int v;
-  QMDDnodeptr lastp,p;
+  unsigned int v,h;
+  QMDDnodeptr p;
+  UTable *ut;
   
   if(QMDDterminal(e)) // there is a unique terminal node
   {
 	e.p=QMDDzero.p;
 	return(e);
   }
-  								         
-  key=0;
-// note hash function shifts pointer values so that order is important
-// suggested by Dr. Nigel Horspool and helps significantly
-  for(i=0;i<Nedge;i++)
-    key+=(((intptr_t)e.p->e[i].p)>>i+e.p->e[i].w);
-  key=(key)&HASHMASK;
   
   v=(unsigned int)e.p->v;
-  p=Unique[v][key]; // find pointer to appropriate collision chain
+  ut=&Unique[v];
+  h=e.p->hash=(unsigned int)UThash(e.p);
+  QMDDlock(UTlock[v]);
+  p=ut->bucket[h&(ut->nbucket-1)]; // find pointer to appropriate collision chain
   //lastp=NULL;	    // pN: not necessary, don't need to jump back to predecessor
-  while(p!=NULL)    // search for a match
+  while(p!=NULL)    // search for a match (comparing the cached hashes first)
   {
-	if(memcmp(e.p->e,p->e,Nedge*sizeof(QMDDedge))==0) 
+	if(p->hash==h&&UTmatchEdges(e.p,p)) 
 	{
 	  // Match found
-	  e.p->next=Avail; 	// put node pointed to by e.p on avail chain
-	  Avail=e.p;
+	  QMDDfreeNode(e.p); 	// put node pointed to by e.p on avail chain
 	  
 	  // NOTE: reference counting is to be adjusted by function invoking the table lookup
-	  UTmatch++;		// record hash table match
+	  QMDDcount(UTmatch);		// record hash table match
+	  ut->match++;
 	  
 	  e.p=p;		// and set it to point to node found (with weight unchanged)
 	  
@@ -626,194 +854,362 @@ QMDDedge QMDDutLookup(QMDDedge e)
 	    exit(66);
 	  e.w = Cdiv(e.w,e.p->renormFactor);   
 	  }
+	  QMDDunlock(UTlock[v]);
 	  return(e);       
 	}
 	
-	UTcol++; 		// record hash collision
+	QMDDcount(UTcol); 		// record hash collision
+	ut->col++;
 	//lastp=p;
 	p=p->next;
   }
-  e.p->next=Unique[v][key]; // if end of chain is reached, this is a new node
-  Unique[v][key]=e.p;       // add it to front of collision chain
+  if(!QMDDterminal(e)) QMDDcheckSpecialMatrices(e); // check if it is identity or diagonal if nonterminal
+  QMDDutInsert(e.p);        // if end of chain is reached, this is a new node
+  QMDDunlock(UTlock[v]);
 																							    
+  QMDDlock(NodeLock);
   QMDDnodecount++;          // count that it exists
   if(QMDDnodecount>QMDDpeaknodecount) QMDDpeaknodecount=QMDDnodecount;
-
-  if(!QMDDterminal(e)) QMDDcheckSpecialMatrices(e); // check if it is identity or diagonal if nonterminal
+  QMDDunlock(NodeLock);
  
   return(e);                // and return
 }
 
 
+static int CTstale;	// set by QMDDcomputeTableStale: the tables are emptied before they are used again
+
 void QMDDinitComputeTable(void)
 // set compute table to empty and
-// set toffoli gate table to empty and
+// set gate table to empty and
 // set identity table to empty
 {
-  int i;
+  int i,t;
+  TTentryptr g,gnext;
   
-  for(i=0;i<CTSLOTS;i++)
-   {
-    CTable[i].r.p=NULL;
-    CTable[i].which=none;
+  CTstale=0;
+  for(t=0;t<CTTABLES;t++)
+    for(i=0;i<CTsize;i++)
+    {
+      CTable[t][i].r.p=NULL;
+      CTable[t][i].which=none;
+    }
+  for(i=0;i<TTbuckets;i++)
+  {
+    for(g=TTable[i];g!=NULL;g=gnext)
+    {
+      gnext=g->next;
+      free(g);
+    }
+    TTable[i]=NULL;
   }
-  for(i=0;i<TTSLOTS;i++)
-    TTable[i].e.p=NULL;
+  TTentries=0;
   for(i=0;i<MAXN;i++) QMDDid[i].p=NULL;
   QMDDnullEdge.p=NULL;
   QMDDnullEdge.w=1;
 }
 
-void QMDDgarbageCollect(void)
-// a simple garbage collector that removes nodes with 0 ref count from the unique
-// tables placing them on the available space chain
+void QMDDcomputeTableStale(void)
+// the compute, gate and identity tables may refer to nodes that have been freed
+// or changed outside garbage collection (QMDDswap); they are emptied by the next 
+// operation that uses them (QMDDinitComputeTable is too costly per swap)
 {
-  int i,j;
-  int count,counta;
-  QMDDnodeptr p,lastp,nextp;
+  CTstale=1;
+}
+
+#define CTcheckStale() if(CTstale) QMDDinitComputeTable()
+
+static long CTkept,CTdropped;	// compute table entries kept / dropped by garbage collections
+
+static int QMDDedgeValid(QMDDedge e)
+// after garbage collection: 0 if e refers to a reclaimed node
+{
+  return(e.p==NULL||QMDDterminal(e)||e.p->ref>0);
+}
+
+static void QMDDcleanComputeTable(void)
+// remove the entries of the compute, gate and identity tables that refer to
+// nodes reclaimed by the garbage collector; all other entries are kept
+// (gate table entries built for an earlier variable order are removed as well)
+{
+  int i,t;
+  CTentry *c;
+  TTentryptr *g,gnext;
   
-  if(QMDDnodecount<GCcurrentLimit) return; // do not collect if below GCcurrentLimit node count
-  count=counta=0;
-  //printf("starting garbage collector %d nodes\n",QMDDnodecount);
-  for(i=0;i<MAXN;i++)
-    for(j=0;j<NBUCKET;j++)
-    {
-      lastp=NULL;
-      p=Unique[i][j];
-      while(p!=NULL)
+  for(t=0;t<CTTABLES;t++)
+    for(i=0,c=CTable[t];i<CTsize;i++,c++)
+      if(c->r.p!=NULL)
       {
-        if(p->ref==0)
+        if(!QMDDedgeValid(c->a)||!QMDDedgeValid(c->b)||!QMDDedgeValid(c->r))
         {
-          if(p==QMDDtnode) printf("error in garbage collector\n");
-          count++;
-          nextp=p->next;
-          if(lastp==NULL) Unique[i][j]=p->next;
-          else lastp->next=p->next;
-          p->next=Avail;
-          Avail=p;
-          p=nextp;
+          c->r.p=NULL;
+          c->which=none;
+          CTdropped++;
         }
-        else
-        {
-          lastp=p;
-          p=p->next;
-          counta++;
-	    }
+        else CTkept++;
       }
-    }
-  //printf("%d nodes recovered %d nodes active\n",count,counta);
-  GCcurrentLimit+=GCLIMIT_INC;
-  QMDDnodecount=counta;
-  QMDDinitComputeTable();  // IMPORTANT sets compute table to empty after garbage collection
+  for(i=0;i<TTbuckets;i++)
+    for(g=&TTable[i];*g!=NULL;)
+      if((*g)->order!=QMDDorderStamp||!QMDDedgeValid((*g)->e))
+      {
+        gnext=(*g)->next;
+        free(*g);
+        *g=gnext;
+        TTentries--;
+      }
+      else g=&(*g)->next;
+  for(i=0;i<MAXN;i++)
+    if(QMDDid[i].p!=NULL&&!QMDDedgeValid(QMDDid[i])) QMDDid[i].p=NULL;
 }
 
-QMDDnodeptr QMDDgetNode(void)
+static void QMDDgrowComputeTable(void)
+// called by the garbage collector: enlarge the compute tables to CTPERNODE 
+// entries per live node (a power of 2, all tables together at most CTmaxMB);
+// the entries are rehashed into the new tables, the oldest entry of each set first
+// so the order within the new sets is kept
 {
-// get memory space for a node
-//
-  QMDDnodeptr r,r2;
-  int i,j;
-      
-  if(Avail!=NULL)	// get node from avail chain if possible
+  int t,i,j,n;
+  long max;
+  CTentry *old[CTTABLES],*c;
+  
+  max=(long)CTmaxMB*1024*1024/((long)CTTABLES*sizeof(CTentry));
+  for(n=CTsize;n<(double)QMDDnodecount*CTPERNODE&&2L*n<=max&&n<INT_MAX/2;n*=2);
+  if(n==CTsize) return;
+  for(t=0;t<CTTABLES;t++)
+  {
+    old[t]=CTable[t];
+    CTable[t]=(CTentry *)malloc(n*sizeof(CTentry));
+    if(CTable[t]==NULL) // keep the current tables if there is no memory for larger ones
+    {
+      while(t>=0) { free(CTable[t]); CTable[t]=old[t]; t--; }
+      return;
+    }
+    for(i=0;i<n;i++)
+    {
+      CTable[t][i].r.p=NULL;
+      CTable[t][i].which=none;
+    }
+  }
+  i=CTsize;
+  CTsize=n;
+  for(t=0;t<CTTABLES;t++)
   {
-	r=Avail;
-	Avail=Avail->next;
-  } else {			// otherwise allocate 2000 new nodes
+    for(c=old[t];c<old[t]+i;c+=CTWAYS)
+      for(j=CTWAYS-1;j>=0;j--)
+        if(c[j].r.p!=NULL) CTinsert(c[j].a,c[j].b,c[j].r,c[j].which);
+    free(old[t]);
+  }
+  CTresizes++;
+}
 
-  //printf("no space available. allocate 2000 new nodes\n");
+static void QMDDcomputeTableWeights(void (*f)(int))
+// apply f (Cincref or Cdecref) to the weights held by the compute, gate and 
+// identity tables, so that the complex garbage collector keeps them
+{
+  int i,t;
+  CTentry *c;
+  TTentryptr g;
+  
+  for(t=0;t<CTTABLES;t++)
+    for(i=0,c=CTable[t];i<CTsize;i++,c++)
+      if(c->r.p!=NULL)
+      {
+        f(c->a.w);
+        f(c->b.w);
+        f(c->r.w);
+      }
+  for(i=0;i<TTbuckets;i++)
+    for(g=TTable[i];g!=NULL;g=g->next)
+    {
+      f(g->e.w);
+      for(t=0;t<Nedge;t++) f(g->w[t]); // the key must keep its values too
+    }
+  for(i=0;i<MAXN;i++)
+    if(QMDDid[i].p!=NULL) f(QMDDid[i].w);
+}
 
-  j=sizeof(QMDDnode);//+Nedge*sizeof(QMDDedge);				// estimated value of a QMDDnode ! DANGER ous. pN calculated 44=sizeof(QMDDnode)+Nedge*sizeof(QMDDedge)
-  r=(QMDDnodeptr)malloc(2000*j);
-  r2=(QMDDnodeptr)((long)r+j);
-  Avail=r2;
-  for(i=0;i<1998;i++,r2=(QMDDnodeptr)((long)r2+j))
+long QMDDutReclaim(int v)
+// put the dead nodes of the unique table of variable v on the available space
+// chain and shrink the table if it has become sparse; returns the no. of nodes freed
+// (no node that is kept may point to them, i.e. all dead nodes above v must go too)
+{
+  int j,n;
+  long count;
+  QMDDnodeptr p,lastp,nextp;
+  
+  count=0;
+  for(j=0;j<Unique[v].nbucket;j++)
   {
-    r2->next=(QMDDnodeptr)((long)r2+j);
+    lastp=NULL;
+    p=Unique[v].bucket[j];
+    while(p!=NULL)
+    {
+      if(p->ref==0)
+      {
+        if(p==QMDDtnode) printf("error in garbage collector\n");
+        count++;
+        Unique[v].nodes--;
+        nextp=p->next;
+        if(lastp==NULL) Unique[v].bucket[j]=p->next;
+        else lastp->next=p->next;
+        QMDDfreeNode(p);
+        p=nextp;
+      }
+      else
+      {
+        lastp=p;
+        p=p->next;
+      }
+    }
   }
-	r2->next=NULL;
+  Unique[v].dead=0;
+  n=Unique[v].nbucket; // shrink tables that have become sparse
+  while(n>NBUCKET&&Unique[v].nodes<(long)n/4*UTMAXLOAD) n/=2;
+  if(n!=Unique[v].nbucket) QMDDutResize(v,n);
+  QMDDnodecount-=count;
+  return(count);
+}
+
+void QMDDgarbageCollect(void)
+// a simple garbage collector that removes nodes with 0 ref count from the unique
+// tables placing them on the available space chain
+// only the tables of variables that have dead nodes are swept
+//
+// the next collection is due once the tables hold GClimitFactor times the nodes
+// that survived this one (at least GCinitialLimit, at most GCmaxLimit if set), so
+// a collection that finds mostly live nodes is not repeated after every gate
+{
+  int i;
+  long count,otime;
+  double limit;
+  
+  if(QMDDnodecount<GCcurrentLimit) return; // do not collect if below GCcurrentLimit node count
+  CTcheckStale(); // entries for nodes freed by QMDDswap cannot be told apart by their ref count
+  otime=cpuTime();
+  count=0;
+  //printf("starting garbage collector %d nodes\n",QMDDnodecount);
+  for(i=0;i<MAXN;i++)
+    if(Unique[i].dead!=0) count+=QMDDutReclaim(i);
+  //printf("%d nodes recovered %d nodes active\n",count,counta);
+  QMDDnodecount=0;
+  for(i=0;i<MAXN;i++) QMDDnodecount+=Unique[i].nodes;
+  limit=QMDDnodecount*GClimitFactor+GCLIMIT_INC;
+  if(limit<GCinitialLimit) limit=GCinitialLimit;
+  if(GCmaxLimit>0&&limit>GCmaxLimit) limit=GCmaxLimit;
+  GCcurrentLimit=(limit>INT_MAX)?INT_MAX:(int)limit;
+  QMDDcleanComputeTable();  // IMPORTANT drop table entries that refer to reclaimed nodes
+  QMDDgrowComputeTable();   // let the compute tables keep up with the unique tables
+  QMDDcomputeTableWeights(Cincref); // the weights of the remaining entries must survive
+  QMDDcomplexGarbageCollect(); // reclaim weights that are no longer referenced by any live edge
+  QMDDcomputeTableWeights(Cdecref);
+  QMDDreleaseNodeChunks(); // give empty node chunks back to the system (after the tables are clean)
+  GCcount++;
+  GCreclaimed+=count;
+  GCtime+=cpuTime()-otime;
+}
+
+
+static QMDDedge *RCstack;	// explicit stack of edges for QMDDincref and QMDDdecref
+static int RCstackSize,RCtop;
+
+static inline void RCpush(QMDDedge e)
+{
+  if(RCtop==RCstackSize)
+  {
+    RCstackSize=RCstackSize?2*RCstackSize:1024;
+    RCstack=(QMDDedge *)realloc(RCstack,RCstackSize*sizeof(QMDDedge));
+    if(RCstack==NULL) throwException("QMDDincref/QMDDdecref: out of memory", 1);
   }
-  r->next=NULL;
-  r->ref=0;			// set reference count to 0
-  r->ident=r->diag=r->block=0;		// mark as not identity or diagonal
-  return(r);
+  RCstack[RCtop++]=e;
 }
 
 void QMDDincref(QMDDedge e)
 // increment reference counter for node e points to
-// and recursively increment reference counter for 
-// each child if this is the first reference
+// and increment reference counter for each child 
+// if this is the first reference (children are processed
+// from an explicit stack, not recursively)
+//
+// exceeding MAXREFCNT is an error
 //
-// a ref count saturates and remains unchanged if it has reached
-// MAXREFCNT
+// the reference count of the edge weight is incremented as well
 {
-  int i;
+  int i,base;
   
-  if (QMDDterminal(e))
-    return;
+  base=RCtop;
+  RCpush(e);
+  while(RCtop>base)
+  {
+    e=RCstack[--RCtop];
+    Cincref(e.w);
   
-  if(e.p->ref==MAXREFCNT) { printf("MAXREFCNT reached\n\n\n"); return; }
-  e.p->ref++;
+    if (QMDDterminal(e))
+      continue;
   
-  /*if (e.p->ref > largestRefCount) { //record maximum of Reference counts
-   largestRefCount = e.p->ref;
-   if (largestRefCount % 1000 == 0)
-     printf("new MAXREF %d  ... %d, %d\n", largestRefCount, (intptr_t) e.p, (intptr_t) QMDDzero.p);
-  }*/
+    if(e.p->ref==MAXREFCNT) throwException("QMDDincref: reference count overflow", 8);
+    e.p->ref++;
   
-  if(e.p->ref==1)
-  {  
-    if(!QMDDterminal(e)) for(i=0;i<Nedge;i++)
-      if(e.p->e[i].p!=NULL) QMDDincref(e.p->e[i]);
+    if(e.p->ref==1)
+    {  
+      for(i=0;i<Nedge;i++)
+        if(e.p->e[i].p!=NULL) RCpush(e.p->e[i]);
       
-    Active[e.p->v]++;
-    ActiveNodeCount++;
-
-    /******* Part added for sifting purposes ********/
-    if(e.p->block)
-      blockMatrixCounter++;
-    /******* by Niemann, November 2012 ********/
-    
+      Active[e.p->v]++;
+      Unique[e.p->v].dead--;
+      ActiveNodeCount++;
+
+      /******* Part added for sifting purposes ********/
+      if(e.p->block)
+        blockMatrixCounter++;
+      /******* by Niemann, November 2012 ********/
+    }
   }
 }
 
 
 void QMDDdecref(QMDDedge e)
 // decrement reference counter for node e points to
-// and recursively decrement reference counter for 
-// each child if this is the last reference
+// and decrement reference counter for each child 
+// if this is the last reference (children are processed
+// from an explicit stack, not recursively)
 //
-// a ref count saturates and remains unchanged if it has reached
-// MAXREFCNT
+// the reference count of the edge weight is decremented as well
 {
-  int i;
+  int i,base;
   
-  if (QMDDterminal(e))
-    return;
-  
-  if(e.p->ref==MAXREFCNT) return;
-  e.p->ref--;
-  if(e.p->ref == (unsigned int) -1) // ERROR CHECK 
-  {
-    printf("error in decref %d\n",e.p->ref);
-    QMDDdebugnode(e.p);
-    exit(8);
-  }
-  if(e.p->ref==0)
+  base=RCtop;
+  RCpush(e);
+  while(RCtop>base)
   {
-    if(!QMDDterminal(e)) for(i=0;i<Nedge;i++)
-    if(e.p->e[i].p!=NULL) QMDDdecref(e.p->e[i]);
-    Active[e.p->v]--;
-    if(Active[e.p->v]<0) printf("ERROR in decref\n");
-    ActiveNodeCount--;
+    e=RCstack[--RCtop];
+    Cdecref(e.w);
+  
+    if (QMDDterminal(e))
+      continue;
+  
+    if(e.p->ref==0) // ERROR CHECK 
+    {
+      printf("error in decref %d\n",e.p->ref);
+      QMDDdebugnode(e.p);
+      exit(8);
+    }
+    e.p->ref--;
+    if(e.p->ref==0)
+    {
+      for(i=0;i<Nedge;i++)
+        if(e.p->e[i].p!=NULL) RCpush(e.p->e[i]);
+      Active[e.p->v]--;
+      if(Active[e.p->v]<0) printf("ERROR in decref\n");
+      Unique[e.p->v].dead++;
+      ActiveNodeCount--;
     
-    /******* Part added for sifting purposes ********/
-    if(e.p->renormFactor != 1){	    
-      RenormalizationNodeCount--;
-      e.p->renormFactor = 1;
+      /******* Part added for sifting purposes ********/
+      if(e.p->renormFactor != 1){	    
+        RenormalizationNodeCount--;
+        e.p->renormFactor = 1;
+      }
+      if(e.p->block)
+        blockMatrixCounter--;
+      /******* by Niemann, November 2012 ********/
     }
-    if(e.p->block)
-      blockMatrixCounter--;
-    /******* by Niemann, November 2012 ********/
   }
 }
 
@@ -850,7 +1246,46 @@ void QMDDradixPrint(int p,int n)
     printf("%d",buffer[i]);
 }
 
-#define CThash(a,b) (((((long)a.p+(long)b.p)>>3)+(int)a.w+(int)b.w+(int)which)&CTMASK)
+#define CTtable(which) ((which)==add?0:(which)==mult?1:(which)==kronecker?2:3) // compute table used for an operation
+#define CTsetLock(set,which) CTlock[(((set)-CTable[CTtable(which)])/CTWAYS)&(CTLOCKS-1)] // lock guarding a set
+
+static inline CTentry *CTset(QMDDedge a,QMDDedge b,CTkind which)
+// the set of compute table entries that may hold the result for (a,b,which)
+{
+  uint64_t key;
+  
+  key=((uint64_t)(intptr_t)a.p^a.w)*UINT64_C(0x9E3779B97F4A7C15);
+  key=(key^(uint64_t)(intptr_t)b.p)*UINT64_C(0xC2B2AE3D27D4EB4F);
+  key=(key^b.w^((uint64_t)which<<32))*UINT64_C(0x9E3779B97F4A7C15);
+  return(CTable[CTtable(which)]+((key>>32)&(CTsize/CTWAYS-1))*CTWAYS);
+}
+
+void QMDDallocComputeTable(void)
+// allocate the compute tables with CTslots entries each (rounded to a power of 2,
+// but all tables together at most CTmaxMB) and the gate table (TTSLOTS buckets initially)
+{
+  int t,n;
+  long max;
+  
+  if(CTslots<=0) throwException("QMDDallocComputeTable: CTslots (QMDD_CTSLOTS) must be positive", 1);
+  max=(long)CTmaxMB*1024*1024/((long)CTTABLES*sizeof(CTentry));
+  for(n=CTWAYS;n<CTslots&&2L*n<=max&&n<INT_MAX/2;n*=2);
+  CTslots=CTsize=n;
+  for(t=0;t<CTTABLES;t++)
+  {
+    free(CTable[t]);
+    CTable[t]=(CTentry *)malloc(CTsize*sizeof(CTentry));
+    if(CTable[t]==NULL) throwException("QMDDallocComputeTable: out of memory", 1);
+  }
+  CTresizes=0;
+  if(TTable==NULL)
+  {
+    TTable=(TTentryptr *)calloc(TTSLOTS,sizeof(TTentryptr));
+    if(TTable==NULL) throwException("QMDDallocComputeTable: out of memory", 1);
+    TTbuckets=TTSLOTS;
+  }
+  QMDDinitComputeTable();
+}
 
 QMDDedge CTlookup(QMDDedge a,QMDDedge b,CTkind which)
 {
@@ -858,63 +1293,134 @@ QMDDedge CTlookup(QMDDedge a,QMDDedge b,CTkind which)
 // return NULL if not a match else returns result of prior computation
   int i;
   QMDDedge r;
+  CTentry *set;
   
+  CTcheckStale();
   r.p=NULL;
-  CTlook[which]++;
-  i=CThash(a,b);
-  if(CTable[i].which!=which) return(r);
-  if(CTable[i].a.p!=a.p||CTable[i].a.w!=a.w) return(r);
-  if(CTable[i].b.p!=b.p||CTable[i].b.w!=b.w) return(r);
-  if((CTable[i].r.p)->v==-1) return(r);  /* fix */
-  CThit[which]++;
-  return(CTable[i].r);
+  QMDDcount(CTlook[which]);
+  set=CTset(a,b,which);
+  QMDDlock(CTsetLock(set,which));
+  for(i=0;i<CTWAYS;i++)
+    if(set[i].which==which&&QMDDedgeEqual(set[i].a,a)&&QMDDedgeEqual(set[i].b,b))
+    {
+      QMDDcount(CThit[which]);
+      r=set[i].r;
+      break;
+    }
+  QMDDunlock(CTsetLock(set,which));
+  return(r);
 }
 
 void CTinsert(QMDDedge a,QMDDedge b,QMDDedge r,CTkind which)
 {
 // put an entry into the compute table
+// the newest entry of a set comes first; the oldest one is evicted
   int i;
+  CTentry *set;
  
-  i=CThash(a,b);
-  CTable[i].a=a;
-  CTable[i].b=b;
-  CTable[i].r=r;
-  CTable[i].which=which;
+  CTcheckStale();
+  set=CTset(a,b,which);
+  QMDDlock(CTsetLock(set,which));
+  for(i=0;i<CTWAYS-1;i++) // an entry for the same arguments is replaced
+    if(set[i].which==which&&QMDDedgeEqual(set[i].a,a)&&QMDDedgeEqual(set[i].b,b)) break;
+  memmove(&set[1],&set[0],i*sizeof(CTentry));
+  set[0].a=a;
+  set[0].b=b;
+  set[0].r=r;
+  set[0].which=which;
+  QMDDunlock(CTsetLock(set,which));
 }
 
-int TThash(int n,int m,int t,int line[])
+static unsigned int TThash(unsigned int w[],int n,int line[])
+// hash value of a gate for the gate table (before masking)
 {
-  int i,j;
-  i=t;
-  for(j=0;j<n;j++) if(line[j]==1) i=i<<3+j;
-  return(i&TTMASK);
+  uint64_t key;
+  int i;
+  
+  key=n;
+  for(i=0;i<Nedge;i++)
+    key=(key^w[i])*UINT64_C(0x9E3779B97F4A7C15);
+  for(i=0;i<n;i++)
+    key=(key^(uint64_t)(line[i]+1))*UINT64_C(0xC2B2AE3D27D4EB4F);
+  return((unsigned int)(key^(key>>32)));
+}
+
+static int TTmatch(TTentryptr g,unsigned int h,unsigned int w[],int n,int line[])
+// compares the key of gate table entry g with (w,n,line)
+{
+  int i;
+  
+  if(g->hash!=h||g->n!=n||g->order!=QMDDorderStamp) return(0);
+  for(i=0;i<Nedge;i++) if(g->w[i]!=w[i]) return(0);
+  for(i=0;i<n;i++) if(g->line[i]!=line[i]) return(0);
+  return(1);
+}
+
+static void TTresize(int nbucket)
+// rehash the gate table into nbucket buckets (a power of 2)
+{
+  TTentryptr *old,g,gnext;
+  int oldn,i;
+  
+  old=TTable;
+  oldn=TTbuckets;
+  TTable=(TTentryptr *)calloc(nbucket,sizeof(TTentryptr));
+  if(TTable==NULL) throwException("TTresize: out of memory", 1);
+  TTbuckets=nbucket;
+  for(i=0;i<oldn;i++)
+    for(g=old[i];g!=NULL;g=gnext)
+    {
+      gnext=g->next;
+      g->next=TTable[g->hash&(nbucket-1)];
+      TTable[g->hash&(nbucket-1)]=g;
+    }
+  free(old);
 }
 
-QMDDedge TTlookup(int n,int m,int t,int line[])
-// does not work with SIFTING!! Idea: TT should be initialized
+QMDDedge TTlookup(unsigned int w[],int n,int line[])
+// look up the QMDD of the gate with matrix w (complex table indices) and
+// line connections line[0..n-1] as built by QMDDmvlgate
+// returns an edge with p==NULL if the gate is not in the table
 {
   QMDDedge r;
-  int i,j;
+  TTentryptr g;
+  unsigned int h;
+  
+  CTcheckStale();
   r.p=NULL;
-  i=TThash(n,m,t,line);
-  if(TTable[i].e.p==NULL||TTable[i].t!=t||TTable[i].m!=m||TTable[i].n!=n) return(r);
-  //for(j=0;j<n;j++) if(TTable[i].line[j]!=line[j]) return(r);
-  if(0==memcmp(TTable[i].line,line,n*sizeof(int))) return(TTable[i].e);
+  TTlook++;
+  h=TThash(w,n,line);
+  for(g=TTable[h&(TTbuckets-1)];g!=NULL;g=g->next)
+    if(TTmatch(g,h,w,n,line))
+    {
+      TThit++;
+      return(g->e);
+    }
   return(r);
 }
 
-void TTinsert(int n,int m,int t,int line[],QMDDedge e)
+void TTinsert(unsigned int w[],int n,int line[],QMDDedge e)
+// put the QMDD e of a gate into the gate table (key as for TTlookup)
+// the entry is valid for the current variable order only
 {
-  int i,j;
-  i=TThash(n,m,t,line);
-  TTable[i].n=n;
-  TTable[i].m=m;
-  TTable[i].t=t;
-  memcpy(TTable[i].line,line,n*sizeof(int));
-  TTable[i].e=e;
+  TTentryptr g;
+  int i;
+  
+  CTcheckStale();
+  g=(TTentryptr)malloc(sizeof(TTentry));
+  if(g==NULL) throwException("TTinsert: out of memory", 1);
+  g->hash=TThash(w,n,line);
+  g->order=QMDDorderStamp;
+  g->n=n;
+  for(i=0;i<Nedge;i++) g->w[i]=w[i];
+  for(i=0;i<n;i++) g->line[i]=line[i];
+  g->e=e;
+  g->next=TTable[g->hash&(TTbuckets-1)];
+  TTable[g->hash&(TTbuckets-1)]=g;
+  if(++TTentries>TTbuckets) TTresize(2*TTbuckets);
 }
 
-void QMDDfillmat(short mat[MAXDIM][MAXDIM],QMDDedge a,int r,int c,int dim,short v,char vtype[])
+void QMDDfillmat(int mat[MAXDIM][MAXDIM],QMDDedge a,int r,int c,int dim,short v,char vtype[])
 // recursively scan an QMDD putting values in entries of mat
 // v is the variable index
 {
@@ -1022,7 +1528,6 @@ QMDDedge QMDDmakeNonterminal(short v,QMDDedge edge[])
    
   e.p=QMDDgetNode();  // get space and form node
   e.w=1;
-  e.sentinel=0;  // see QMDDpackage.h for information about sentinel
   e.p->v=v;
   e.p->renormFactor=1;
   e.p->computeSpecialMatricesFlag = globalComputeSpecialMatricesFlag;
@@ -1042,7 +1547,6 @@ QMDDedge QMDDmakeTerminal(complex c)
   
   e.p=QMDDtnode;
   e.w=Clookup(c);
-  e.sentinel=0;	// see QMDDpackage.h for information about sentinel
   return(e);
 }
 
@@ -1052,36 +1556,63 @@ void QMDDinit(int verbose)
 //
   int i,j;
   
-  jl_init(NULL);
-  
-  jl_eval_string("push!(LOAD_PATH, \"/Users/home/JULIA/QMDD/src\")");
-  jl_eval_string("using QMDDcomplex");
-
+  if(getenv("QMDD_CTSLOTS")) // large values are capped by QMDDallocComputeTable
+  {
+    long l=strtol(getenv("QMDD_CTSLOTS"),NULL,10);
+    CTslots=l>INT_MAX?INT_MAX:l<0?0:(int)l;
+  }
+  if(getenv("QMDD_CTMAXMB")) CTmaxMB=atoi(getenv("QMDD_CTMAXMB"));
+  if(getenv("QMDD_GCLIMIT")) GCinitialLimit=atoi(getenv("QMDD_GCLIMIT")); // per run tuning
+  if(getenv("QMDD_GCFACTOR")) GClimitFactor=atof(getenv("QMDD_GCFACTOR"));
+  if(getenv("QMDD_GCMAX")) GCmaxLimit=atoi(getenv("QMDD_GCMAX"));
+  if(getenv("QMDD_THREADS")) QMDDthreads=atoi(getenv("QMDD_THREADS"));
+  if(getenv("QMDD_PARDEPTH")) QMDDparDepth=atoi(getenv("QMDD_PARDEPTH"));
+  if(getenv("QMDD_PARMIN")) QMDDparMinVars=atoi(getenv("QMDD_PARMIN"));
+  if(getenv("QMDD_WINDOW")) QMDDbuildWindow=atoi(getenv("QMDD_WINDOW"));
+  if(getenv("QMDD_FUSE")) QMDDfuseMax=atoi(getenv("QMDD_FUSE"));
+#ifdef _OPENMP
+  static int lockInit=0;
+  
+  if(!lockInit)
+  {
+    for(i=0;i<MAXN;i++) omp_init_lock(&UTlock[i]);
+    for(i=0;i<CTLOCKS;i++) omp_init_lock(&CTlock[i]);
+    omp_init_lock(&NodeLock);
+    lockInit=1;
+  }
+#endif
   if(verbose)
   {
     printf(QMDDversion);
     printf("compiled: %s %s\n\n",__DATE__,__TIME__);
     printf("Edge size %d bytes\n",sizeof(QMDDedge));
-    printf("Node size %d bytes\n",sizeof(QMDDnode)+Nedge*sizeof(QMDDedge));
-    printf("Max variables %d\nUT buckets / variable %d\nCompute table slots %d\nToffoli table slots %d\nGarbage collection limit %d\nGarbage collection increment %d\nComplex number table size %d\n",MAXN,NBUCKET,CTSLOTS,TTSLOTS,GCLIMIT1,GCLIMIT_INC,COMPLEXTSIZE);
+    printf("Node size %d bytes\n",(int)sizeof(QMDDnode));
+    printf("Max variables %d\nUT initial buckets / variable %d\nCompute table entries %d (%d-way, %d tables, at most %d MB)\nGate table initial buckets %d\nGarbage collection limit %d\nGarbage collection increment %d\nGarbage collection limit factor %.2f\nComplex number table initial size %d\n",MAXN,NBUCKET,CTslots,CTWAYS,CTTABLES,CTmaxMB,TTSLOTS,GCinitialLimit,GCLIMIT_INC,GClimitFactor,COMPLEXTSIZE);
   }
   Pi=2.0*acos(0.0);	   // set value of global Pi
   
   Nedge=Radix*Radix;	   // set number of edges
+  QMDDallocComputeTable(); // allocate compute tables with CTslots entries each
 
   QMDDcomplexInit();	   // init complex number package
   //QMDDinitComputeTable();  // init computed table to empty
   
-  GCcurrentLimit=GCLIMIT1; // set initial garbage collection limit
+  GCcurrentLimit=GCinitialLimit; // set initial garbage collection limit
+  GCcount=GCreclaimed=GCtime=0;
+  CTkept=CTdropped=0;
 
   UTcol = UTmatch = 0;
   QMDDnodecount=0;			// zero node counter
   QMDDpeaknodecount=0;
   Nlabel=0;                		// zero variable label counter
   Nop[0]=Nop[1]=Nop[2]=0;		// zero op counter
-  CTlook[0]=CTlook[1]=CTlook[2]=CThit[0]=CThit[1]=CThit[2]=0;		// zero CTable counters
+  for(i=0;i<CTKINDS;i++) CTlook[i]=CThit[i]=0;		// zero CTable counters
+  for(i=0;i<QMDDnodeChunks;i++)	// release all node chunks
+    if(QMDDnodeChunk[i]!=NULL) munmap(QMDDnodeChunk[i],NODECHUNKBYTES);
+  QMDDnodeChunks=0;
+  QMDDchunksReleased=0;
   Avail=NULL;				// set available node list to empty
-  Lavail=NULL;				// set available element list to empty
+  QMDDfreeListElements();		// set available element list to empty
   QMDDtnode=QMDDgetNode();		// create terminal node - note does not go in unique table
   QMDDtnode->ident=1;
   QMDDtnode->diag=1;
@@ -1099,9 +1630,14 @@ void QMDDinit(int verbose)
   QMDDzero=QMDDmakeTerminal(CmakeZero());
   QMDDone=QMDDmakeTerminal(CmakeOne());
   Clookup(CmakeMOne());		// (?) guarantees that 0,1,-1 are in CT slots 0,1,2
-  for(i=0;i<MAXN;i++)
-    for(j=0;j<NBUCKET;j++) // set unique tables to empty
-      Unique[i][j]=NULL;
+  for(i=0;i<MAXN;i++)      // set unique tables to empty
+  {
+    free(Unique[i].bucket);
+    Unique[i].bucket=(QMDDnodeptr *)calloc(NBUCKET,sizeof(QMDDnodeptr));
+    if(Unique[i].bucket==NULL) throwException("QMDDinit: out of memory", 1);
+    Unique[i].nbucket=NBUCKET;
+    Unique[i].nodes=Unique[i].dead=Unique[i].col=Unique[i].match=0;
+  }
   for(i=0;i<MAXN;i++)      //  set initial variable order to 0,1,2... from bottom up
   {
     QMDDorder[i]=QMDDinvorder[i]=i;
@@ -1112,16 +1648,26 @@ void QMDDinit(int verbose)
   if(verbose)printf("QMDD initialization complete\n----------------------------------------------------------\n");
 }
 
-QMDDedge QMDDadd(QMDDedge x,QMDDedge y)
-// adds two matrices represented by QMDD
-// the two QMDD should have the same variable set and ordering
+static inline int QMDDtopLevel(QMDDedge x,QMDDedge y)
+// no. of variables up to and including the top variable of x and y
 {
-  QMDDedge e1,e2,e[MAXNEDGE],r;
+  int var;
+  
+  var=0;
+  if(!QMDDterminal(x)&&(QMDDinvorder[x.p->v]+1)>var) var=QMDDinvorder[x.p->v]+1;
+  if(!QMDDterminal(y)&&(QMDDinvorder[y.p->v]+1)>var) var=QMDDinvorder[y.p->v]+1;
+  return(var);
+}
+
+static QMDDedge QMDDadd2(QMDDedge x,QMDDedge y)
+// adds two matrices represented by QMDD (see QMDDadd)
+{
+  QMDDedge e1,e2,e[MAXNEDGE],r,xn,yn,rn;
   int i,w;
   
   if(x.p==NULL) return(y);  // handles partial matrices i.e.
   if(y.p==NULL) return(x);  // column and row vetors
-  Nop[add]++;
+  QMDDcount(Nop[add]);
   if((!MultMode)&&(QMDDterminal(y)||x.p>y.p))
   {
     e1=x;
@@ -1144,8 +1690,19 @@ QMDDedge QMDDadd(QMDDedge x,QMDDedge y)
     if(r.w==0) r=QMDDzero;
     return(r);
   }
-  r=CTlookup(x,y,add);
-  if(r.p!=NULL) return(r);
+  // the compute table is keyed on (x.p,1) and (y.p,y.w/x.w): additions that
+  // differ by a common factor share one entry, the result is rescaled by x.w
+  xn.p=x.p;
+  xn.w=1;
+  yn.p=y.p;
+  yn.w=Cdiv(y.w,x.w);
+  r=CTlookup(xn,yn,add);
+  if(r.p!=NULL)
+  {
+    r.w=Cmul(r.w,x.w);
+    if(r.w==0) r=QMDDzero;
+    return(r);
+  }
 
   if(QMDDterminal(x)) w=y.p->v;
   else {
@@ -1154,6 +1711,9 @@ QMDDedge QMDDadd(QMDDedge x,QMDDedge y)
       if(QMDDinvorder[y.p->v]>QMDDinvorder[w]) w=y.p->v;
   }
 
+#ifdef _OPENMP
+  int spawn=QMDDparallel&&QMDDinvorder[w]>=QMDDparLevel; // upper levels: child additions are parallel tasks
+#endif
   for(i=0;i<Nedge;i++)
   {
     if(!QMDDterminal(x)&&x.p->v==w)
@@ -1184,13 +1744,74 @@ QMDDedge QMDDadd(QMDDedge x,QMDDedge y)
         e2.w=0;
       }
     }
-    e[i]=QMDDadd(e1,e2);
+#ifdef _OPENMP
+    if(spawn)
+    {
+      #pragma omp task firstprivate(e1,e2,i) shared(e)
+      e[i]=QMDDadd2(e1,e2);
+      continue;
+    }
+#endif
+    e[i]=QMDDadd2(e1,e2);
+  }
+#ifdef _OPENMP
+  if(spawn)
+  {
+    #pragma omp taskwait
   }
+#endif
   r=QMDDmakeNonterminal(w/*x.p->v*/,e);  /// sept 29
-  CTinsert(x,y,r,add);
+  rn=r;
+  rn.w=Cdiv(r.w,x.w);
+  CTinsert(xn,yn,rn,add);
   return(r);
 }
 
+QMDDedge QMDDadd(QMDDedge x,QMDDedge y)
+// adds two matrices represented by QMDD
+// the two QMDD should have the same variable set and ordering
+//
+// with PARALLEL=openmp and QMDDthreads>1, the child additions of the upper
+// QMDDparDepth levels are OpenMP tasks run by QMDDthreads threads
+// (operands with fewer than QMDDparMinVars variables are added sequentially)
+//
+// only the recursion below (QMDDadd2, QMDDmultiply2) runs in parallel: it uses
+// the unique, compute and complex tables, which are locked while QMDDparallel
+// is set, but not the gate table or the identity cache; QMDDadd and QMDDmultiply
+// themselves, like every other package routine, must be called from one thread
+{
+#ifdef _OPENMP
+  int var;
+  
+  if(!QMDDparallel) CTcheckStale(); // not from within the parallel tasks
+  if(QMDDthreads>1&&QMDDparDepth>0&&!QMDDparallel&&x.p!=NULL&&y.p!=NULL&&
+     (var=QMDDtopLevel(x,y))>=QMDDparMinVars)
+  {
+    QMDDedge r;
+    
+    QMDDparLevel=var-QMDDparDepth;
+    QMDDparallel=1;
+    #pragma omp parallel num_threads(QMDDthreads)
+    #pragma omp single
+    r=QMDDadd2(x,y);
+    QMDDparallel=0;
+    return(r);
+  }
+#endif
+  return(QMDDadd2(x,y));
+}
+
+static inline QMDDedge QMDDmultOperand(QMDDedge x,int w,int i)
+// edge i of x if x is labelled with variable w (weighted by x.w), otherwise x itself
+{
+  QMDDedge e;
+  
+  if(QMDDterminal(x)||x.p->v!=w) return(x);
+  e=x.p->e[i];
+  e.w=Cmul(e.w,x.w);
+  return(e);
+}
+
 QMDDedge QMDDmultiply2(QMDDedge x,QMDDedge y, int var)
 
 // new multiply routine designed to handle missing variables properly
@@ -1206,7 +1827,7 @@ QMDDedge QMDDmultiply2(QMDDedge x,QMDDedge y, int var)
   if(x.p==NULL) return(x);
   if(y.p==NULL) return(y);
 
-  Nop[mult]++;
+  QMDDcount(Nop[mult]);
  
   if(x.w==0||y.w==0)  // the 0 case
   {
@@ -1260,6 +1881,30 @@ QMDDedge QMDDmultiply2(QMDDedge x,QMDDedge y, int var)
 
   }
   
+#ifdef _OPENMP
+  if(QMDDparallel&&var>QMDDparLevel) // upper levels: the sub-products are computed by parallel tasks
+  {                                  // and then added in the same order as below
+    QMDDedge prod[MAXNEDGE][MAXRADIX];
+    
+    for(i=0;i<Nedge;i+=Radix)
+      for(j=0;j<Radix;j++)
+        for(k=0;k<Radix;k++)
+        {
+          e1=QMDDmultOperand(x,w,i+k);
+          e2=QMDDmultOperand(y,w,j+Radix*k);
+          #pragma omp task firstprivate(e1,e2,i,j,k) shared(prod)
+          prod[i+j][k]=QMDDmultiply2(e1,e2,var-1);
+        }
+    #pragma omp taskwait
+    for(i=0;i<Nedge;i++)
+    {
+      e[i].p=NULL;
+      e[i].w=0;
+      for(k=0;k<Radix;k++)
+        e[i]=QMDDadd(e[i],prod[i][k]);
+    }
+  } else
+#endif
   for(i=0;i<Nedge;i+=Radix)
   {
     for(j=0;j<Radix;j++)
@@ -1268,21 +1913,8 @@ QMDDedge QMDDmultiply2(QMDDedge x,QMDDedge y, int var)
       e[i+j].w=0;
       for(k=0;k<Radix;k++)
       {
-        if(!QMDDterminal(x)&&x.p->v==w)
-        {
-          e1=x.p->e[i+k];
-          e1.w=Cmul(e1.w,x.w);
-        } else {
-          e1=x;
-        }
-        if(!QMDDterminal(y)&&y.p->v==w)
-        {
-          e2=y.p->e[j+Radix*k];
-          e2.w=Cmul(e2.w,y.w);
-        } else {
-          e2=y;
-        }
-        
+        e1=QMDDmultOperand(x,w,i+k);
+        e2=QMDDmultOperand(y,w,j+Radix*k);
         e[i+j]=QMDDadd(e[i+j],QMDDmultiply2(e1,e2,var-1));
       } 
     }
@@ -1297,13 +1929,30 @@ QMDDedge QMDDmultiply2(QMDDedge x,QMDDedge y, int var)
 }
 
 QMDDedge QMDDmultiply(QMDDedge x,QMDDedge y)
+// with PARALLEL=openmp and QMDDthreads>1, the sub-products of the upper 
+// QMDDparDepth levels are OpenMP tasks run by QMDDthreads threads
+// (operands with fewer than QMDDparMinVars variables are multiplied sequentially)
+// (see QMDDadd for which parts are thread-safe)
 {
   int var;
   
-  var=0;
-  if(!QMDDterminal(x)&&(QMDDinvorder[x.p->v]+1)>var) var=QMDDinvorder[x.p->v]+1;
-  if(!QMDDterminal(y)&&(QMDDinvorder[y.p->v]+1)>var) var=QMDDinvorder[y.p->v]+1;
+  var=QMDDtopLevel(x,y);
   
+#ifdef _OPENMP
+  if(!QMDDparallel) CTcheckStale(); // not from within the parallel tasks
+  if(QMDDthreads>1&&QMDDparDepth>0&&!QMDDparallel&&var>=QMDDparMinVars)
+  {
+    QMDDedge r;
+    
+    QMDDparLevel=var-QMDDparDepth;
+    QMDDparallel=1;
+    #pragma omp parallel num_threads(QMDDthreads)
+    #pragma omp single
+    r=QMDDmultiply2(x,y,var);
+    QMDDparallel=0;
+    return(r);
+  }
+#endif
   return(QMDDmultiply2(x,y,var));
 }
 
@@ -1315,7 +1964,7 @@ QMDDedge QMDDkron(QMDDedge a,QMDDedge b)
    int i,j;
    
    if(a.p==NULL) return(a);
-   Nop[kronecker]++;
+   QMDDcount(Nop[kronecker]);
    if(a.w==0) 
    {
      return(QMDDzero);
@@ -1475,6 +2124,7 @@ QMDDedge QMDDident(int x,int y)
   if (y<0)
     return QMDDone;
   
+  CTcheckStale();
   if(x==0&&QMDDid[y].p!=NULL) 
   {
     return(QMDDid[y]);
@@ -1512,6 +2162,9 @@ QMDDedge QMDDmvlgate(complex mat[MAXRADIX][MAXRADIX],int n,int line[])
 // -1 not connected
 // 0...Radix-1 indicates a control by that value
 // Radix indicates the line is the target
+//
+// gates are kept in the gate table, so every gate is built only once
+// for a given variable order
 {
   
   //printf("QMDDmvlgate: %d,%d;%d,%d   %d\n", mat[0][0], mat[0][1], mat[1][0], mat[1][1], n);
@@ -1519,10 +2172,14 @@ QMDDedge QMDDmvlgate(complex mat[MAXRADIX][MAXRADIX],int n,int line[])
   
    QMDDedge e,f,em[MAXNEDGE],fm[MAXNEDGE],temp;
    int i,i1,i2,w,z,j,k,t;
+   unsigned int key[MAXNEDGE];
      
    for(i=0;i<Radix;i++)
      for(j=0;j<Radix;j++)
        em[i*Radix+j]=QMDDmakeTerminal(mat[i][j]);
+   for(i=0;i<Nedge;i++) key[i]=em[i].w;
+   e=TTlookup(key,n,line);
+   if(e.p!=NULL) return(e);
    e=QMDDone;
    for(z=0;line[w=QMDDorder[z]]<Radix;z++) //process lines below target
    {
@@ -1583,6 +2240,7 @@ QMDDedge QMDDmvlgate(complex mat[MAXRADIX][MAXRADIX],int n,int line[])
            if(i1==i2) fm[i1+i2*Radix]=e; else fm[i1+i2*Radix]=QMDDzero;
        e=QMDDmakeNonterminal(w,fm);
      }
+   TTinsert(key,n,line,e);
    return(e);
 }
 
@@ -1610,15 +2268,13 @@ void QMDDmatrixPrint(QMDDedge a,short v,char vtype[], std::ostream &os)
 // v is the variable index for the top vertex
 {
 
-  short mat[MAXDIM][MAXDIM];
+  int mat[MAXDIM][MAXDIM];
   
   int m,n,i,j,mode,p,perm;
   
-  short cTabPrint[COMPLEXTSIZE]; // print only values of used entries of the UniqueTable   // pN 120920
+  int cTabSize;
+  char *cTabPrint; // print only values of used entries of the UniqueTable   // pN 120920
   bool cTabPrintFlag = false;
-  
-  for (int i=0; i<COMPLEXTSIZE; i++)
-    cTabPrint[i] = 0;
 
   
   if(QMDDterminal(a)) n=0; else n=v+1;
@@ -1639,6 +2295,8 @@ void QMDDmatrixPrint(QMDDedge a,short v,char vtype[], std::ostream &os)
 
 //	printf("DebugPN: No problems so far.");
   QMDDfillmat(mat,a,0,0,m,v,vtype); // convert to matrix
+  cTabSize = Ctablesize(); // may have grown while filling the matrix
+  cTabPrint = (char*) calloc(cTabSize, sizeof(char));
 //	printf("DebugPN: No problems so far. Matrix filled.");
 	
   mode=0;
@@ -1663,7 +2321,7 @@ void QMDDmatrixPrint(QMDDedge a,short v,char vtype[], std::ostream &os)
     {
       if(mode>2&&m<=MAXDIM){           // display complex value
         //Cprint(gCvalue(mat[i][j]), os);
-        cTabPrint[ mat[i][j] ] = 1;
+        if (mat[i][j] >= 0 && mat[i][j] < cTabSize) cTabPrint[ mat[i][j] ] = 1;
 	cTabPrintFlag = true;
 	if (mat[i][j] < 10)
 	  os << " ";
@@ -1730,13 +2388,14 @@ void QMDDmatrixPrint(QMDDedge a,short v,char vtype[], std::ostream &os)
   if (cTabPrintFlag) {
     os << "ComplexTable values: (0): 0; (1): 1; ";
   
-    for (int i=2; i<COMPLEXTSIZE; i++)
+    for (int i=2; i<cTabSize; i++)
       if (cTabPrint[i]) {
 	os << "(" << i << "):";
 	Cprint(gCvalue(i), os);
 	os << "; ";
       }   
   }    
+  free(cTabPrint);
   
   os << "\n";
 }
@@ -1811,16 +2470,61 @@ int QMDDsize(QMDDedge e)
   return(QMDDnodeCount(e));
 }
 
+void QMDDutChainHistogram(void)
+// displays how many unique table buckets (all variables) have collision chains of length 0,1,...
+{
+  long hist[UTMAXCHAIN+1];
+  int i,j,len,longest;
+  QMDDnodeptr p;
+  
+  for(i=0;i<=UTMAXCHAIN;i++) hist[i]=0;
+  longest=0;
+  for(i=0;i<MAXN;i++)
+  {
+    if(Unique[i].nodes==0) continue;
+    for(j=0;j<Unique[i].nbucket;j++)
+    {
+      len=0;
+      for(p=Unique[i].bucket[j];p!=NULL;p=p->next) len++;
+      if(len>longest) longest=len;
+      hist[len<UTMAXCHAIN?len:UTMAXCHAIN]++;
+    }
+  }
+  printf("UniqueTable chain lengths (buckets of non-empty tables), longest %d:\n",longest);
+  for(i=0;i<=UTMAXCHAIN;i++)
+    if(hist[i]>0) printf("  %s%d: %ld\n",i==UTMAXCHAIN?">=":"",i,hist[i]);
+}
+
 void QMDDstatistics(void)
 // displays QMDD package statistics
 {
+  int i,j;
+  long look;
+  
   printf("\nCurrent # nodes in unique tables: %ld\n\n",QMDDnodecount);
-  printf("Total compute table lookups: %ld\n",CTlook[0]+CTlook[1]+CTlook[2]);
+  for(i=look=0;i<CTKINDS;i++) look+=CTlook[i];	// all operation kinds
+  printf("Total compute table lookups: %ld\n",look);
   printf("Number of ops: adds %d mults %d Kronecker %d\n",Nop[add],Nop[mult],Nop[kronecker]);
   printf("Compute table hit ratios: \naddition %d/%d %5.2f per cent \nmultiplication %d/%d %5.2f per cent \nKronecker product %d/%d %5.2f per ceent\n",CThit[add],CTlook[add],
         (float)CThit[add]/CTlook[add]*100,CThit[mult],CTlook[mult],(float)CThit[mult]/CTlook[mult]*100,CThit[kronecker],
         CTlook[kronecker],(float)CThit[kronecker]/CTlook[kronecker]*100);
-  printf("UniqueTable Collisions: %d, Matches: %d\n", UTcol, UTmatch);
+  printf("Compute tables: %d entries each (%d-way set-associative, %ld KB in total), enlarged %ld times\n",
+    CTsize,CTWAYS,(long)CTTABLES*CTsize*(long)sizeof(CTentry)/1024,CTresizes);
+  printf("Compute table entries kept / dropped by garbage collection: %ld / %ld\n",CTkept,CTdropped);
+  printf("Gate table: %ld entries, %d buckets, hits %ld/%ld\n",TTentries,TTbuckets,TThit,TTlook);
+  printf("UniqueTable Collisions: %ld, Matches: %ld\n", UTcol, UTmatch);
+  QMDDutChainHistogram();
+  printf("Garbage collections: %ld, nodes reclaimed %ld, CPU time ",GCcount,GCreclaimed);
+  printCPUtime(GCtime);
+  printf(" s, current limit %d\n",GCcurrentLimit);
+  for(i=j=0;i<QMDDnodeChunks;i++) if(QMDDnodeChunk[i]!=NULL) j++;
+  printf("Node store: %d chunks of %d nodes (%ld KB), %ld chunks released\n",
+    j,NODECHUNK,(long)(j*NODECHUNKBYTES/1024),QMDDchunksReleased);
+  for(i=0;i<MAXN;i++)
+    if(Unique[i].nodes>0||Unique[i].col+Unique[i].match>0)
+      printf("  variable %d: %ld nodes, %d buckets, collisions %ld, matches %ld\n",
+        i,Unique[i].nodes,Unique[i].nbucket,Unique[i].col,Unique[i].match);
+  QMDDcomplexStatistics();
   
 }
 
@@ -20,29 +20,48 @@
 
 #define MAXSTRLEN 11
 #define MAXN 100			// max no. of inputs
+#define LABELHASH 256		// slots of the variable name hash table (power of 2, more than 2*MAXN)
 #define MAXRADIX 2    		// max logic radix                                		   
 #define MAXNEDGE 4 			// max no. of edges = MAXRADIX^2
 #define MAXNODECOUNT 2000000 	// max number of nodes in a QMDD for counting 			   
-#define GCLIMIT1 250000   	// first garbage collection limit                          
+#define GCLIMIT1 250000   	// first garbage collection limit (also the smallest limit used)
 #define GCLIMIT_INC 0 		// garbage collection limit increment                      
 							// added to garbage collection limit after each collection
+#define GCLIMITFACTOR 2.0	// after a collection the limit is set to this multiple of the surviving nodes
+#define GCLIMITMAX 0		// largest garbage collection limit (0 = no bound)
 #define MAXND 6    			// max n for display purposes
 #define MAXDIM 64           	// max dimension of matrix for printing, (should be 2^MAXND)				   
-#define NBUCKET 8192     	// no. of hash table buckets; must be a power of 2 		   
-#define HASHMASK 8191   	// must be nbuckets-1                 					   
-#define CTSLOTS 16384  		// no. of computed table slots 							   
-#define CTMASK  16383  		// must be CTSLOTS-1   
-#define COMPLEXTSIZE 2000  	// complex table size  
+#define NBUCKET 64     	// initial no. of hash table buckets per variable; must be a power of 2
+#define UTMAXLOAD 1		// unique table is doubled when it holds more than UTMAXLOAD nodes per bucket
+#define UTMAXCHAIN 8		// chains of this length or longer share one class in the chain length histogram
+#define CTSLOTS 16384  		// default no. of entries per compute table; must be a power of 2
+#define CTWAYS 4		// associativity of the compute tables (entries per set)
+#define CTTABLES 4		// compute tables: addition, multiplication, Kronecker product, other operations
+#define CTKINDS 20		// size of the per-kind lookup/hit counters (at least the no. of CTkind values)
+#define CTPERNODE 1		// at garbage collection the compute tables grow to this many entries per live node
+#define CTMAXMB 256		// default memory cap for all compute tables together (MB)
+#define CTLOCKS 4096		// locks guarding the compute table sets in parallel operations; must be a power of 2
+#define PARTHREADS 1		// default no. of threads for QMDDmultiply and QMDDadd (1 = sequential)
+#define PARDEPTH 3		// default no. of QMDD levels at which QMDDmultiply and QMDDadd spawn parallel tasks
+#define PARMINVARS 8		// default no. of variables below which QMDDmultiply and QMDDadd run sequentially
+#define BUILDWINDOW 1		// default gates per window in QMDDcircuitRevlib (0 = balanced tree)
+#define FUSEMAX 0		// default max. no. of lines of fused gates in QMDDcircuitRevlib (0 = no fusion)
+#define COMPLEXTSIZE 2000  	// initial complex table size (doubled whenever it is full)
 #define COMPLEXTMASK 127   	// complex table index mask   (not used anywhere?!)
-#define TTSLOTS 2048		// Toffoli table slots
-#define TTMASK 2047			// must be TTSLOTS-1
-#define MAXREFCNT 40000		// max reference count (saturates at this value)    
+#define CCSLOTS 16384		// complex operation cache slots
+#define CCMASK 16383		// must be CCSLOTS-1
+#define TTSLOTS 2048		// initial no. of gate table buckets; must be a power of 2
+				// (doubled when the table holds more entries than buckets)
+#define MAXREFCNT UINT_MAX	// max reference count (exceeding it is an error)    
+				// (a node is referenced by at most MAXNEDGE edges of each parent and by
+				// the roots, so this takes about 2^30 parents - 60 GB of compact nodes)
 #define MAXPL 65536			// max size for a permutation recording
 
 #define DYNREORDERLIMIT 500	// minimum value for dynamic reordering limit
 #define VERBOSE 0
 
 #include <stdint.h>
+#include <limits.h>
 #include <iostream>
 #include "QMDDcomplex.h"
 #include <sstream>
@@ -50,33 +69,79 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <cstddef>
 
 // edge and node definitions 
 
+// nodes are allocated in chunks of NODECHUNK nodes (a whole number of pages), each
+// chunk counts its live nodes and is given back to the system once it is empty
+
+#define NODECHUNKSHIFT 11
+#define NODECHUNK (1<<NODECHUNKSHIFT)	// nodes per chunk of the node store
+
+struct QMDDnode;
+EXTERN QMDDnode **QMDDnodeChunk;	// chunk table of the node store (NULL for released chunks)
+
+#ifndef QMDD_COMPACT_NODES
+
 typedef struct QMDDnode *QMDDnodeptr; 
 
+#else
+
+// compact node store (make NODES=compact): nodes are addressed by a 32-bit
+// handle (chunk number, index in chunk) instead of a pointer, so an edge
+// takes 8 instead of 16 bytes.
+// Handle 0 is the null handle; NULL converts to it. 
+
+class QMDDnodeptr
+{
+   uint32_t h;
+public:
+   QMDDnodeptr() = default;
+   QMDDnodeptr(std::nullptr_t) : h(0) {}
+   explicit QMDDnodeptr(uint32_t handle) : h(handle) {}
+   inline QMDDnode *operator->() const;
+   inline QMDDnode &operator*() const;
+   bool operator==(const QMDDnodeptr &q) const { return h==q.h; }
+   bool operator!=(const QMDDnodeptr &q) const { return h!=q.h; }
+   bool operator<(const QMDDnodeptr &q) const { return h<q.h; }
+   bool operator>(const QMDDnodeptr &q) const { return h>q.h; }
+   explicit operator intptr_t() const { return (intptr_t)h; }
+   uint32_t handle() const { return h; }
+};
+
+#endif
+
 typedef struct QMDDedge
 {
    QMDDnodeptr p;  		// edge pointer 											 
    unsigned int w;          	// index of weight edge in complex value table 		
-   int sentinel;		// in 64-bit architecture sizeof(QMDDedge) is a multiple of 8 (8 Byte = 64 bit).
-				// So sizeof() is 16 with AND without this sentinel. thus when using memcmp identical nodes may not be identified. 
 }  QMDDedge;
 
 typedef struct QMDDnode
 {
    QMDDnodeptr next;  // link for unique table and available space chain 
    unsigned int ref;  // reference count 												 
-   unsigned char v;   // variable index (nonterminal) value (-1 for terminal)
    unsigned int renormFactor; // factor that records renormalization factor
+   unsigned int hash; // unique table hash of the edges (set by QMDDutLookup)
+   unsigned char v;   // variable index (nonterminal) value (-1 for terminal)
    char ident,diag,block,symm,c01;        // flag to mark if vertex heads a QMDD for a special matrix
    char computeSpecialMatricesFlag;	  // flag to mark whether SpecialMatrices are to be computed
+#ifndef QMDD_COMPACT_NODES
+   unsigned int chunk; // chunk of the node store holding this node (uses padding space)
+#endif
    //QMDDedge e[0]; 	  	// edges out of this node - variable so must be last in structure 
    QMDDedge e[MAXNEDGE];	// when calling malloc in QMDDgetnode
 }  QMDDnode;
 
+#ifdef QMDD_COMPACT_NODES
+inline QMDDnode *QMDDnodeptr::operator->() const { return QMDDnodeChunk[h>>NODECHUNKSHIFT]+(h&(NODECHUNK-1)); }
+inline QMDDnode &QMDDnodeptr::operator*() const { return *operator->(); }
+#endif
+
 
 // list definitions for breadth first traversals (e.g. printing)  
+#define LISTBLOCK 256		// list elements allocated at a time (all released at the end of a traversal)
 typedef struct ListElement *ListElementPtr;
 
 typedef struct ListElement
@@ -97,12 +162,28 @@ typedef struct CTentry// computed table entry defn
   CTkind which;       // type of operation 												 
 } CTentry;
 
-typedef struct TTentry // Toffoli table entry defn
+typedef struct TTentry *TTentryptr;
+
+typedef struct TTentry // gate table entry defn (a gate QMDD built by QMDDmvlgate)
 {
-  int n,m,t,line[MAXN];
+  TTentryptr next;		// collision chain
+  unsigned int hash;		// hash of the key (n, w, line)
+  unsigned int order;		// QMDDorderStamp when the QMDD was built
+  int n;			// no. of lines
+  unsigned int w[MAXNEDGE];	// gate matrix (complex table indices)
+  signed char line[MAXN];	// -1 not connected, 0..Radix-1 control value, Radix target
   QMDDedge e;
 } TTentry;
 
+typedef struct UTable // unique table for one variable
+{
+  QMDDnodeptr *bucket;	// collision chains, nbucket of them
+  int nbucket;		// no. of buckets (power of 2)
+  long nodes;		// no. of nodes in the table (active or not)
+  long dead;		// no. of nodes in the table with ref count 0 (garbage collector skips the table if 0)
+  long col,match;	// collisions / matches for this variable
+} UTable;
+
 typedef struct CircuitLine
 {
   char input[MAXSTRLEN];
@@ -121,6 +202,8 @@ typedef struct QMDDrevlibDescription // circuit description structure
   char version[MAXSTRLEN];
   char inperm[MAXN],outperm[MAXN];
   char ngate,cgate,tgate,fgate,pgate,vgate,kind[7],dc[5],name[32],no[8],modified;
+  char gateline[MAXN];	// lines (controls and target) of the last gate read
+  signed char labelHash[LABELHASH];	// line index per variable name slot, -1 if empty (see QMDDhashLabels)
 } QMDDrevlibDescription;
 
 
@@ -166,19 +249,42 @@ EXTERN QMDDnodeptr Nlist[MAXNODECOUNT];
 
 EXTERN long Nop[6];				// operation counters
 
-EXTERN long CTlook[20],CThit[20];	// counters for gathering compute table hit stats 
+EXTERN long CTlook[CTKINDS],CThit[CTKINDS];	// counters for gathering compute table hit stats 
 
-EXTERN long UTcol, UTmatch;			// counter for collisions / matches in hash tables   
+EXTERN long UTcol, UTmatch;			// counter for collisions / matches in hash tables (all variables)
 
 EXTERN int GCcurrentLimit;			// current garbage collection limit 
 
+EXTERN long GCcount, GCreclaimed;	// no. of garbage collections / nodes reclaimed by them
+EXTERN long GCtime;			// CPU time spent in the garbage collector
+
 EXTERN int ActiveNodeCount;		// number of active nodes 
 
 EXTERN int Active[MAXN];			// number of active nodes for each variable 
 
+EXTERN int QMDDparallel;		// set while a parallel operation runs: shared tables are locked
+					// (only QMDDmultiply and QMDDadd set it; the package is not thread-safe
+					// otherwise and must be called from a single thread)
+
 #ifndef DEFINE_VARIABLES
 EXTERN int GCswitch;           // set switch to 1 to enable garbage collection 
 
+EXTERN int CTslots;		// initial entries per compute table, set before calling QMDDinit (or QMDD_CTSLOTS)
+EXTERN int CTmaxMB;		// memory cap for the compute tables in MB, set before calling QMDDinit (or QMDD_CTMAXMB)
+
+EXTERN int GCinitialLimit;	// garbage collection limit tuning, set before calling QMDDinit
+EXTERN double GClimitFactor;	// (or through the environment variables QMDD_GCLIMIT,
+EXTERN int GCmaxLimit;		// QMDD_GCFACTOR and QMDD_GCMAX, which QMDDinit reads)
+
+EXTERN int QMDDthreads;		// threads for QMDDmultiply and QMDDadd, levels at which they spawn
+EXTERN int QMDDparDepth;	// tasks and smallest no. of variables for parallel operation (only
+EXTERN int QMDDparMinVars;	// with PARALLEL=openmp; or QMDD_THREADS, QMDD_PARDEPTH and QMDD_PARMIN)
+
+EXTERN int QMDDbuildWindow;	// QMDDcircuitRevlib multiplies the gates in windows of this many gates,
+				// 1 = left to right, 0 = balanced binary tree (or QMDD_WINDOW)
+EXTERN int QMDDfuseMax;		// consecutive gates on at most this many lines are multiplied together
+				// before they are multiplied in, 0 = no fusion (or QMDD_FUSE)
+
 EXTERN int Smode;				// S mode switch for spectral transformation
 							// Smode==1 0->+1 1->-1; Smode==0 0->0 1->1
 
@@ -208,23 +314,29 @@ EXTERN int largestRefCount;
 	
 *******************************************/
 
-EXTERN QMDDnodeptr Unique[MAXN][NBUCKET];
+EXTERN UTable Unique[MAXN];
 
 /****************************************************
 
-    Compute Table (only one for all operation types)
+    Compute Tables (CTTABLES tables, CTWAYS-way set-associative)
     
 ****************************************************/
 
-EXTERN CTentry CTable[CTSLOTS];
+EXTERN CTentry *CTable[CTTABLES];	// CTsize entries each, grouped in sets of CTWAYS entries
+EXTERN int CTsize;			// current entries per compute table (grows with the unique tables)
+EXTERN long CTresizes;			// no. of times the compute tables were enlarged
 
 /****************************************************
 
-    Toffoli gate table
+    Gate table (QMDDs of single gates, all gate types)
 
 *****************************************************/
 
-EXTERN TTentry TTable[TTSLOTS];
+EXTERN TTentryptr *TTable;		// collision chains, TTbuckets of them
+EXTERN int TTbuckets;			// no. of buckets (power of 2)
+EXTERN long TTentries;			// no. of entries in the table
+EXTERN long TTlook,TThit;		// gate table lookups / hits
+EXTERN unsigned int QMDDorderStamp;	// changed by QMDDswap; gate QMDDs built for another order are not used
 
 /****************************************************
 
@@ -259,6 +371,16 @@ EXTERN FILE *outfile;
 int Radix = 2;				// radix (default is 2) 
 int Nedge=4;				// no. of edges (default is 4) 
 int GCswitch = 1;           // set switch to 1 to enable garbage collection
+int CTslots = CTSLOTS;		// initial entries per compute table
+int CTmaxMB = CTMAXMB;		// memory cap for the compute tables (MB)
+int QMDDthreads = PARTHREADS;	// threads for QMDDmultiply and QMDDadd
+int QMDDparDepth = PARDEPTH;	// levels at which QMDDmultiply and QMDDadd spawn tasks
+int QMDDparMinVars = PARMINVARS;	// smaller operands are processed sequentially
+int QMDDbuildWindow = BUILDWINDOW;	// gates per window when building a circuit QMDD (0 = balanced tree)
+int QMDDfuseMax = FUSEMAX;		// max. lines of fused gates when building a circuit QMDD (0 = no fusion)
+int GCinitialLimit = GCLIMIT1;	// first garbage collection limit
+double GClimitFactor = GCLIMITFACTOR;	// limit after a collection relative to surviving nodes
+int GCmaxLimit = GCLIMITMAX;	// largest garbage collection limit (0 = no bound)
 int Smode = 1;				// S mode switch for spectral transformation
 					// Smode==1 0->+1 1->-1; Smode==0 0->0 1->1
 int RMmode =0;				// Select RM transformation mode
@@ -312,9 +434,12 @@ void QMDDdecref(QMDDedge);
 void QMDDincref(QMDDedge);
 QMDDedge QMDDident(int,int);
 QMDDedge QMDDmvlgate(complex[MAXRADIX][MAXRADIX],int ,int[]);
-void TTinsert(int,int,int,int[],QMDDedge);
-QMDDedge TTlookup(int,int,int,int[]);
+void TTinsert(unsigned int[],int,int[],QMDDedge);
+QMDDedge TTlookup(unsigned int[],int,int[]);
 void QMDDgarbageCollect(void);
+long QMDDutReclaim(int);
+void QMDDfreeNode(QMDDnodeptr);
+void QMDDfreeListElements(void);
 QMDDedge QMDDtranspose(QMDDedge); //prototype
 void QMDDmatrixPrint2(QMDDedge); // prototype
 QMDDedge QMDDnormalize(QMDDedge);
@@ -323,13 +448,18 @@ void QMDDcheckSpecialMatrices(QMDDedge);
 QMDDedge CTlookup(QMDDedge,QMDDedge,CTkind);
 void CTinsert(QMDDedge,QMDDedge,QMDDedge,CTkind);
 void QMDDinitComputeTable(void);
+void QMDDcomputeTableStale(void);
+void QMDDallocComputeTable(void);
 QMDDedge QMDDextractColumn(int[], QMDDedge);
 void QMDDcolumnPrint(QMDDedge,int);
 QMDDedge QMDDutLookup(QMDDedge);
+void QMDDutInsert(QMDDnodeptr);
+void QMDDutResize(int,int);
 QMDDedge QMDDmakeNonterminal(short,QMDDedge[]);
 void QMDDinit(int verbose);
 void QMDDdotExport(QMDDedge basic, int n, char outputFilename[], QMDDrevlibDescription circ, int show);
 void QMDDstatistics(void);
+void QMDDutChainHistogram(void);
 QMDDedge QMDDconjugateTranspose(QMDDedge a);
 QMDDedge QMDDtrace(QMDDedge a, unsigned char var, char remove[], char all);
 void QMDDprintActive(int n);
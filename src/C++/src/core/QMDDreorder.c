@@ -12,6 +12,7 @@ QMDD sifting routines
 
 *********************************************/
 #include "QMDDreorder.h"
+#include "QMDDcircuit.h"
 
 int debugSift = 0;	// must be set to 0 to suppress all debug outputs
 int printLimit = 100;	// number of nodes printed by debug outputs
@@ -212,7 +213,7 @@ void QMDDchangeNonterminal(short v,QMDDedge edge[],QMDDnodeptr p)
   e.p->v=v;
   memcpy(e.p->e,edge,Nedge*sizeof(QMDDedge));
   olde=e;
-  memcpy(&old,e.p,sizeof(QMDDnode));	  
+  old=*e.p;	  
   
   e=QMDDnormalize(e); // normalize it, this may not change the pointer!
   if(olde.p!=e.p) printf("Normalization collapse in change nonterminal\n");
@@ -341,8 +342,9 @@ void QMDDswap(int i)
 // note variable positions are numbered 0,1,2,... from bottom of QMDD
 
 {
-  int j,t,v1,v2;
-  QMDDnodeptr table[NBUCKET],p,pnext,ptemp, plast;
+  int j,t,v1,v2,nbucket;
+  long freed=0;
+  QMDDnodeptr *table,p,pnext, plast;
   char tempLab[MAXSTRLEN]; 
   
   v1=QMDDorder[i];
@@ -353,7 +355,8 @@ void QMDDswap(int i)
   
   
   
-// update variable order
+// update variable order (gate QMDDs built so far no longer apply)
+  QMDDorderStamp++;
   t=QMDDorder[i];
   QMDDorder[i]=QMDDorder[i-1];
   QMDDorder[i-1]=t;
@@ -363,17 +366,19 @@ void QMDDswap(int i)
   strcpy(tempLab,Label[i]);
   strcpy(Label[i],Label[i-1]);
   strcpy(Label[i-1],tempLab);
-// copy unique table for variable v1 and empty source
-  for(t=0;t<NBUCKET;t++)
-  {
-    table[t]=Unique[v1][t];
-    Unique[v1][t]=NULL;
-  }
+// take over unique table for variable v1 and give v1 a new empty table
+// (it grows again as the nodes for v1 are inserted)
+  table=Unique[v1].bucket;
+  nbucket=Unique[v1].nbucket;
+  Unique[v1].bucket=(QMDDnodeptr *)calloc(NBUCKET,sizeof(QMDDnodeptr));
+  if(Unique[v1].bucket==NULL) throwException("QMDDswap: out of memory", 1);
+  Unique[v1].nbucket=NBUCKET;
+  Unique[v1].nodes=Unique[v1].dead=0;
   
 // process nodes one at a time
 
 /// FIRST RUN: check for don't care nodes and insert them immediately
-  for(t=0;t<NBUCKET;t++)
+  for(t=0;t<nbucket;t++)
   {
     p=table[t];
     plast=NULL;  // pointing to the node just before p in the table-collision-chain
@@ -386,9 +391,7 @@ void QMDDswap(int i)
 	  //printf("Debug: found don't care node  %d (does not point to %d) and reinsert it!\n", (intptr_t) p, v2);
          //printf("DC");
 	//***** putting node to the front of the Unique table collision chain *****//
-	ptemp=Unique[v1][t];
-	Unique[v1][t] = p;
-	p->next = ptemp;
+	QMDDutInsert(p);
 	
 	//***** and delete from table[] *******************************************//
 	if (plast == NULL) // p was the first entry in the collision chain
@@ -404,8 +407,13 @@ void QMDDswap(int i)
     }
   }
 
+/// the dead nodes left in table are freed below, so first free the dead nodes
+/// above position i, the only ones that can point to them
+  for(j=0;j<MAXN;j++)
+    if(Unique[j].dead!=0&&QMDDinvorder[j]>i) freed+=QMDDutReclaim(j);
+
 /// SECOND RUN: modify remaining active nodes
-for(t=0;t<NBUCKET;t++)
+for(t=0;t<nbucket;t++)
   {
     p=table[t];
     while(p!=NULL)
@@ -414,12 +422,16 @@ for(t=0;t<NBUCKET;t++)
       if(p->ref!=0) QMDDswapNode(p,v1,v2, i);
       else {
 	// remove inactive node and mark as available
-        //p->next=Avail; // WARNING: potentially buggy ;-)
-        //Avail=p;
+	QMDDfreeNode(p);
+	QMDDnodecount--;
+	freed++;
       }
       p=pnext;
     }
   }
+  free(table);
+/// freed nodes are reused, so cached results that refer to them are dropped
+  if(freed) QMDDcomputeTableStale();
   return;
 }
 
@@ -607,7 +619,7 @@ int lookupLabel(char buffer[], char moveLabel[], QMDDrevlibDescription *circ) {
   int k = 0;
   char ch;
   
-  while(buffer[k]!=' '&&buffer[k]!='\n' && k < 3)
+  while(buffer[k]!=' '&&buffer[k]!='\n'&&buffer[k]!=0 && k < MAXSTRLEN-1)
   {
     ch = buffer[k];
     if(ch>='a'&&ch<='z') ch=ch-'a'+'A'; // convert lowercase letters to uppercase
@@ -617,18 +629,8 @@ int lookupLabel(char buffer[], char moveLabel[], QMDDrevlibDescription *circ) {
   moveLabel[k]=0;
   if (!k){
     printf("No valid label found. \n"); return -1;
-  } else {
-    k=-1;
-    for(int i=0;i<circ->n;i++) 			// lookup up label in table
-    {
-      if(0==strcmp(moveLabel,circ->line[i].variable)) 
-      {
-	k=i; // return if found
-      }
-    }
-    
   }
-  return k;
+  return QMDDfindLabel(moveLabel, circ);	// hash table built by QMDDrevlibHeader
 }
 
 void QMDDreorder(int order[],int n, QMDDedge *root)
@@ -706,7 +708,7 @@ int QMDDmoveVariable(QMDDedge *basic, char buffer[], QMDDrevlibDescription *circ
  */ 
   int k, order[MAXN], bufferOffset, p, q=1, i;
   moveType moveDirection;
-  char moveLabel[3];
+  char moveLabel[MAXSTRLEN];
   
   // look for moving direction
   
@@ -1,5 +1,9 @@
 // text file input output routines 
 #include "textFileUtilities.h"
+#include "QMDDpackage.h"	// throwException
+#include <stdlib.h>
+
+#define TEXTBLOCK 65536	// bytes read at a time by readTextLines
 
 FILE *openTextFile(char *fname,char mode)
 {
@@ -13,11 +17,13 @@ FILE *openTextFile(char *fname,char mode)
 char getch(FILE *infile)
   {
 // fetch one character / convert lowercase to uppercase
-  char ch;
-  fscanf(infile,"%c",&ch);
+// ('\n' at the end of the file)
+  int ch;
+  ch=getc(infile);
   if(ch==13){
-    fscanf(infile,"%c",&ch);
+    ch=getc(infile);
   }
+  if(ch==EOF) return('\n');
   return processChar(ch);
 }
 
@@ -62,7 +68,7 @@ char getstr(FILE *infile,char x[])
   do
   {
     ch=getch(infile);
-  } while(ch==','||ch==' '||ch=='\n');
+  } while((ch==','||ch==' '||ch=='\n')&&!feof(infile));
   i=0;
   while(ch!=','&&ch!=' '&&ch!='\n')
   {
@@ -74,9 +80,12 @@ char getstr(FILE *infile,char x[])
   return(ch);
 }
 
-int getstr(const char line[],char x[])
+int getstr(const char line[],char x[],int size)
 {
-// store next token in x (string encapsulated by {","," ","\n"}), return last character of token
+// store next token in x (string encapsulated by {","," ","\n"} or the end of line), 
+// return no. of characters read (the end of line is not passed, so further
+// calls return empty tokens) or -1 if the token does not fit into the size
+// characters of x (x then holds its first size-1 characters)
   char ch;
   int i,j = 0;
   do
@@ -84,13 +93,19 @@ int getstr(const char line[],char x[])
     ch=processChar(line[j++]);
   } while(ch==','||ch==' '||ch=='\n');
   i=0;
-  while(ch!=','&&ch!=' '&&ch!='\n')
+  while(ch!=','&&ch!=' '&&ch!='\n'&&ch!=0)
   {
+    if(i==size-1)
+    {
+      x[i]=0;
+      return(-1);
+    }
     x[i]=ch;
     i++;
     ch=processChar(line[j++]);
   }
   x[i]=0;
+  if(ch==0) j--;
   return(j);
 }
 
@@ -112,8 +127,7 @@ int getint(FILE *infile)
 void skip2eof(FILE *infile)
 {
 // skips until it reaches end of file
-  char ch;
-  while(EOF!=fscanf(infile,"%c",&ch));
+  fseek(infile,0,SEEK_END);
 }
 
 void skip2eol(FILE *infile)
@@ -127,3 +141,69 @@ void skip2eol(FILE *infile)
 }
 
 
+
+int readTextLines(FILE *infile,TextLines *t)
+{
+// read the rest of infile into memory (in blocks of TEXTBLOCK bytes) and split it 
+// into lines: characters are converted by processChar (CRs are dropped), each line
+// is terminated by 0 and t->line[0..t->n-1] point to the first non-blank character
+// of the lines that are neither empty nor comments (#); returns t->n
+// the lines have no length limit; freeTextLines releases them
+  long len,size,r;
+  int nline;
+  char *p,*w,*start,*nbuf,**nl;
+  
+  size=TEXTBLOCK;
+  len=0;
+  t->buf=(char *)malloc(size+1);
+  if(t->buf==NULL) throwException("readTextLines: out of memory",1);
+  while((r=fread(t->buf+len,1,size-len,infile))>0)
+  {
+    len+=r;
+    if(len==size)
+    {
+      nbuf=(char *)realloc(t->buf,(size*=2)+1);
+      if(nbuf==NULL) throwException("readTextLines: out of memory",1);
+      t->buf=nbuf;
+    }
+  }
+  t->line=NULL;
+  t->n=nline=0;
+  t->buf[len]='\n';
+  
+  w=start=t->buf;
+  for(p=t->buf;p<=t->buf+len;p++) // p never falls behind w, so the text is converted in place
+  {
+    if(*p==13) continue;
+    if((*w=processChar(*p))!='\n')
+    {
+      w++;
+      continue;
+    }
+    *w++=0;
+    while(*start==' ') start++;
+    if(*start!=0&&*start!='#')
+    {
+      if(t->n==nline)
+      {
+        nline=nline?2*nline:1024;
+        nl=(char **)realloc(t->line,nline*sizeof(char *));
+        if(nl==NULL) throwException("readTextLines: out of memory",1);
+        t->line=nl;
+      }
+      t->line[t->n++]=start;
+    }
+    start=w;
+  }
+  return(t->n);
+}
+
+void freeTextLines(TextLines *t)
+{
+// release the lines read by readTextLines
+  free(t->buf);
+  free(t->line);
+  t->buf=NULL;
+  t->line=NULL;
+  t->n=0;
+}
@@ -3,14 +3,23 @@
 
 #include <stdio.h>
 
+typedef struct TextLines // lines of a text file held in memory (see readTextLines)
+{
+  char *buf;	// the text, converted by processChar, each line terminated by 0
+  char **line;	// first character of each line that is neither empty nor a comment
+  int n;	// no. of such lines
+} TextLines;
+
 FILE *openTextFile(char*,char);
 char getch(FILE*);
 char getnbch(FILE*);
 char getstr(FILE*,char*);
-int getstr(const char*,char*);
+int getstr(const char*,char*,int);
 char getline(FILE*,char*);
 char processChar(char);
 int getint(FILE*);
 void skip2eof(FILE*);
 void skip2eol(FILE*);
+int readTextLines(FILE*,TextLines*);
+void freeTextLines(TextLines*);
 #endif
@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#include "src/core/QMDDcore.h"
+#include "src/core/QMDDpackage.h"
+#include "src/core/QMDDcircuit.h"
+
+// reads two circuits that declare their variables in a different order,
+// the second one with its lines matched to the first one (match=1),
+// and checks that both give the same QMDD
+int main() {
+   QMDDrevlibDescription spec,perm;
+
+   QMDDinit(0);
+
+   spec.n=0;
+   spec = QMDDcircuitRevlib((char*)"benchmarks/qFou3.real",spec,0);
+   if (spec.n == 0) {
+     printf("*** Failed to open benchmarks/qFou3.real.\n");
+     return 1;
+   }
+   perm = QMDDcircuitRevlib((char*)"benchmarks/qFou3perm.real",spec,1);
+   if (perm.n == 0) {
+     printf("*** Failed to open benchmarks/qFou3perm.real.\n");
+     return 1;
+   }
+
+   printf("gates %d %d equal %d\n",spec.ngates,perm.ngates,QMDDedgeEqual(spec.e,perm.e));
+   if (spec.ngates != perm.ngates || !QMDDedgeEqual(spec.e,perm.e)) {
+     printf("*** FAILED: matched circuit differs.\n");
+     return 1;
+   }
+   printf("*** passed\n");
+   return 0;
+}
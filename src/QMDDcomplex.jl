@@ -7,8 +7,9 @@ global MAXRADIX = 2
 global Radix = 2
 
 global Ctable = Vector{Complex}(COMPLEXTSIZE)
-global Cmag = Matrix{Float64}(COMPLEXTSIZE,COMPLEXTSIZE)
-global Cangle = Matrix{Float64}(COMPLEXTSIZE,COMPLEXTSIZE)
+# magnitude and angle of each table entry, filled in by Clookup
+global Cmag = Vector{Float64}(COMPLEXTSIZE)
+global Cangle = Vector{Float64}(COMPLEXTSIZE)
 global CTa = Vector{Int64}(MAXRADIX+1)
 global Ctol = 1e-10
 global Ctentries = 2
@@ -34,11 +35,16 @@ global Ctentries = 2
   function QMDDinitComplex()
     Cmag[1]=0
     Cmag[2]=1
+    Cangle[1]=0
+    Cangle[2]=0
     QMDDinitCtable()
   end
 
   function angle(a::Int64)
     ca=Ctable[a]
+    if Cmag[a]==0.0
+      return 0.0
+    end
     if imag(ca)>=0.0
       return acos(real(ca)/Cmag[a])
     else
@@ -26,8 +26,9 @@ global MAXRADIX = 2
 global Radix = 2
 
 global Ctable = Vector{Complex}(COMPLEXTSIZE)
-global Cmag = Matrix{Float64}(COMPLEXTSIZE,COMPLEXTSIZE)
-global Cangle = Matrix{Float64}(COMPLEXTSIZE,COMPLEXTSIZE)
+# magnitude and angle of each table entry, filled in by Clookup
+global Cmag = Vector{Float64}(COMPLEXTSIZE)
+global Cangle = Vector{Float64}(COMPLEXTSIZE)
 global CTa = Vector{Int64}(MAXRADIX+1)
 global Ctol = 1e-10
 global Ctentries = 2
@@ -53,15 +54,20 @@ global Ctentries = 2
   function QMDDinitComplex()
     Cmag[1]=0
     Cmag[2]=1
+    Cangle[1]=0
+    Cangle[2]=0
     QMDDinitCtable()
   end
 
   function angle(a::Int64)
     ca=Ctable[a+1]
+    if Cmag[a+1]==0.0
+      return 0.0
+    end
     if imag(ca)>=0.0
-      return acos(real(ca)/Cmag[a])
+      return acos(real(ca)/Cmag[a+1])
     else
-      return 2π-acos(real(ca)/Cmag[a])
+      return 2π-acos(real(ca)/Cmag[a+1])
     end
   end
   
@@ -115,7 +121,7 @@ global Ctentries = 2
       return 0
     end
     
-    return angle(a)>angle(b)
+    return Cangle[a+1]>Cangle[b+1]
   end    
 
   function Clookup(c::Complex)
@@ -133,7 +139,7 @@ global Ctentries = 2
 
     Ctable[Ctentries]=c
     Cmag[Ctentries]=abs(c)
-    Cangle[Ctentries]=angle(Ctentries)
+    Cangle[Ctentries]=angle(Ctentries-1)
     return Ctentries-1
   end
 